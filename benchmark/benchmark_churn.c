@@ -0,0 +1,374 @@
+/*
+ * Network Stack connection churn and socket scale benchmark
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Opens N connections from the peer stand-in to a listening socket of the
+ * local client, closes them again and repeats this. For a growing N, it reports
+ * the connect, accept and close rates, the latency of getPendingEvents() with
+ * all N sockets readable and with none, and the memory in use. It also reports
+ * the accept rate of socket_acceptMany() for N connections that are all
+ * pending at once.
+ *
+ * Both clients are driven from the main thread, which selects the client for
+ * each call. N doubles up to the number of sockets of the host library, every
+ * connection takes two of them. Declare the library with e.g. MAX_SOCKETS 8192
+ * to scale to thousands of connections, see CMakeLists.txt.
+ */
+
+#include "benchmark_common.h"
+
+#include "network_stack_host.h"
+
+#include "lib_debug/Debug.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHURN_CYCLES        20
+#define FETCH_SAMPLES       1000
+
+// one socket is the listening one
+#define MAX_CONNECTIONS     ((NetworkStack_PicoTcp_MAX_SOCKETS - 1) / 2)
+
+static int localHandles[MAX_CONNECTIONS];
+static int peerHandles[MAX_CONNECTIONS];
+
+static uint64_t fetchSamples[FETCH_SAMPLES];
+
+//------------------------------------------------------------------------------
+static size_t
+get_rss_kib(void)
+{
+    unsigned long size;
+    unsigned long resident = 0;
+
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (NULL == f)
+    {
+        return 0;
+    }
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(f);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+open_connections(
+    int       listenHandle,
+    int       n,
+    uint64_t* pAcceptNs)
+{
+    for (int i = 0; i < n; i++)
+    {
+        OS_Error_t ret = Benchmark_connect(Benchmark_CLIENT_PEER,
+                                           Benchmark_PORT, &peerHandles[i]);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+
+        const uint64_t start = Benchmark_nowNs();
+        ret = Benchmark_accept(Benchmark_CLIENT_LOCAL, listenHandle,
+                               &localHandles[i]);
+        *pAcceptNs += Benchmark_nowNs() - start;
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Accepting connection %d failed, error %d", i, ret);
+            return ret;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Connects all N peers first, as a burst of connections does, and then accepts
+// them with as few socket_acceptMany() calls as possible.
+static OS_Error_t
+open_connections_burst(
+    int       listenHandle,
+    int       n,
+    uint64_t* pAcceptNs)
+{
+    for (int i = 0; i < n; i++)
+    {
+        OS_Error_t ret = Benchmark_connect(Benchmark_CLIENT_PEER,
+                                           Benchmark_PORT, &peerHandles[i]);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    const NetworkStack_PicoTcp_AcceptRecord_t* records =
+        NetworkStack_Host_getClientBuf(Benchmark_CLIENT_LOCAL);
+    int accepted = 0;
+
+    const uint64_t start = Benchmark_nowNs();
+
+    while (accepted < n)
+    {
+        int count = 0;
+
+        NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+        OS_Error_t ret = NetworkStack_Host_socket_acceptMany(listenHandle,
+                                                            n - accepted,
+                                                            &count);
+        if (ret == OS_ERROR_TRY_AGAIN)
+        {
+            uint16_t events;
+            ret = Benchmark_waitEvent(Benchmark_CLIENT_LOCAL, listenHandle,
+                                      OS_SOCK_EV_CONN_ACPT, &events);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Accepting connection %d failed, error %d",
+                            accepted, ret);
+            return ret;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            localHandles[accepted++] = records[i].handle;
+        }
+    }
+
+    *pAcceptNs += Benchmark_nowNs() - start;
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static void
+close_connections(
+    int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, localHandles[i]);
+        Benchmark_close(Benchmark_CLIENT_PEER, peerHandles[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Times the getPendingEvents() call only. The events are not kept for
+// Benchmark_waitEvent(), nothing waits for them afterwards.
+static OS_Error_t
+measure_fetch(
+    int         n,
+    const char* metric,
+    size_t      expectedEvents)
+{
+    NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+    for (int i = 0; i < FETCH_SAMPLES; i++)
+    {
+        size_t numberOfEvents;
+
+        const uint64_t start = Benchmark_nowNs();
+        OS_Error_t ret = NetworkStack_Host_socket_getPendingEvents(
+                             Benchmark_CLIENT_DATAPORT_SIZE,
+                             &numberOfEvents);
+        fetchSamples[i] = Benchmark_nowNs() - start;
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("getPendingEvents() failed, error %d", ret);
+            return ret;
+        }
+        if (numberOfEvents != expectedEvents)
+        {
+            Debug_LOG_WARNING("Fetched %zu events, expected %zu",
+                              numberOfEvents, expectedEvents);
+        }
+    }
+
+    Benchmark_emitLatency("socket_scale", n, metric, fetchSamples,
+                          FETCH_SAMPLES);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Makes all N local sockets readable and measures getPendingEvents() with all
+// of them reported, then drains them and measures it with none reported.
+static OS_Error_t
+measure_event_fetch(
+    int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = 1;
+
+        NetworkStack_Host_setClient(Benchmark_CLIENT_PEER);
+        OS_Error_t ret = NetworkStack_Host_socket_write(peerHandles[i], &len);
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("socket_write() failed, error %d", ret);
+            return ret;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        uint16_t events;
+        OS_Error_t ret = Benchmark_waitEvent(Benchmark_CLIENT_LOCAL,
+                                             localHandles[i], OS_SOCK_EV_READ,
+                                             &events);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    // the read events stay pending until the data is read
+    OS_Error_t ret = measure_fetch(n, "fetch_ready", n);
+    if (ret != OS_SUCCESS)
+    {
+        return ret;
+    }
+
+    NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+    for (int i = 0; i < n; i++)
+    {
+        do
+        {
+            size_t len = Benchmark_CLIENT_BUF_SIZE;
+            ret = NetworkStack_Host_socket_read(localHandles[i], &len);
+        }
+        while (ret == OS_SUCCESS);
+
+        if (ret != OS_ERROR_TRY_AGAIN)
+        {
+            Debug_LOG_ERROR("socket_read() failed, error %d", ret);
+            return ret;
+        }
+    }
+
+    return measure_fetch(n, "fetch_idle", 0);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+churn_run(
+    int listenHandle,
+    int n)
+{
+    uint64_t acceptNs = 0;
+    uint64_t openNs = 0;
+    uint64_t closeNs = 0;
+
+    for (int cycle = 0; cycle < CHURN_CYCLES; cycle++)
+    {
+        const uint64_t start = Benchmark_nowNs();
+        OS_Error_t ret = open_connections(listenHandle, n, &acceptNs);
+        openNs += Benchmark_nowNs() - start;
+
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+
+        if (cycle == CHURN_CYCLES - 1)
+        {
+            Benchmark_emit("socket_scale", n, "rss", get_rss_kib(), "KiB");
+
+            ret = measure_event_fetch(n);
+            if (ret != OS_SUCCESS)
+            {
+                return ret;
+            }
+        }
+
+        const uint64_t closeStart = Benchmark_nowNs();
+        close_connections(n);
+        closeNs += Benchmark_nowNs() - closeStart;
+    }
+
+    const double connections = (double)n * CHURN_CYCLES;
+
+    Benchmark_emit("churn", n, "connect_rate", connections * 1e9 / openNs,
+                   "connections/s");
+    Benchmark_emit("churn", n, "accept_rate", connections * 1e9 / acceptNs,
+                   "accepts/s");
+    Benchmark_emit("churn", n, "close_rate", 2 * connections * 1e9 / closeNs,
+                   "closes/s");
+
+    // the same again with all connections pending before they are accepted
+    acceptNs = 0;
+    for (int cycle = 0; cycle < CHURN_CYCLES; cycle++)
+    {
+        OS_Error_t ret = open_connections_burst(listenHandle, n, &acceptNs);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+        close_connections(n);
+    }
+
+    Benchmark_emit("churn", n, "accept_many_rate",
+                   connections * 1e9 / acceptNs, "accepts/s");
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+int
+main(void)
+{
+    int listenHandle;
+
+    OS_Error_t ret = Benchmark_start("churn", NetworkStack_PicoTcp_MAX_SOCKETS);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Benchmark_start() failed, error %d", ret);
+        return EXIT_FAILURE;
+    }
+
+    ret = Benchmark_listen(Benchmark_CLIENT_LOCAL, Benchmark_PORT,
+                           MAX_CONNECTIONS, &listenHandle);
+    if (ret != OS_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (int n = 1; ; n *= 2)
+    {
+        if (n > MAX_CONNECTIONS)
+        {
+            n = MAX_CONNECTIONS;
+        }
+
+        if (churn_run(listenHandle, n) != OS_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+
+        if (n == MAX_CONNECTIONS)
+        {
+            break;
+        }
+    }
+
+    Benchmark_close(Benchmark_CLIENT_LOCAL, listenHandle);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,659 @@
+/*
+ * Network Stack benchmarks, common functions
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "benchmark_common.h"
+
+#include "network_stack_host.h"
+
+#include "lib_debug/Debug.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCHMARK_NUMBER_OF_CLIENTS 2
+
+// Ethernet, ARP and IPv4 fields the wire looks at
+#define ETH_ADDR_LEN        6
+#define ETH_HEADER_LEN      14
+#define ETH_TYPE_OFFSET     12
+#define ETH_TYPE_ARP        0x0806
+#define ETH_TYPE_IPV4       0x0800
+#define ETH_FRAME_MIN_LEN   60
+#define ETH_FRAME_MAX_LEN   1514
+#define ARP_LEN             28
+#define ARP_OPER_REQUEST    1
+#define ARP_OPER_REPLY      2
+#define IPV4_HEADER_MIN_LEN 20
+#define IPV4_SRC_OFFSET     12
+#define IPV4_DST_OFFSET     16
+
+static const char* suiteName;
+static Benchmark_Path_t currentPath = Benchmark_PATH_LOOPBACK;
+static const char* nicPathName;
+
+// the peer on the wire, see wire_tx_frame()
+static const uint8_t peerMac[ETH_ADDR_LEN] =
+{
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x02
+};
+static uint8_t peerIp[4];
+
+// Events fetched by a client but not yet consumed by Benchmark_waitEvent(),
+// only used by the thread acting as the client. It is an open addressing hash
+// table with linear probing, so the cost of a lookup does not grow with the
+// number of sockets. A socket keeps its slot from its first event until it is
+// closed, there are twice as many slots as sockets.
+#define PENDING_EVENTS_SLOTS    (2 * NetworkStack_PicoTcp_MAX_SOCKETS)
+
+static struct
+{
+    int      handle;
+    uint16_t eventMask;
+} pendingEvents[BENCHMARK_NUMBER_OF_CLIENTS][PENDING_EVENTS_SLOTS];
+
+//------------------------------------------------------------------------------
+// Answers an ARP request for the peer address
+static void
+wire_arp_reply(
+    const uint8_t* request,
+    size_t         len)
+{
+    const uint8_t* arp = &request[ETH_HEADER_LEN];
+
+    // oper at 6, sender MAC at 8, sender IP at 14, target IP at 24
+    if ((len < ETH_HEADER_LEN + ARP_LEN) || (arp[7] != ARP_OPER_REQUEST)
+        || (memcmp(&arp[24], peerIp, sizeof(peerIp)) != 0))
+    {
+        return;
+    }
+
+    uint8_t reply[ETH_FRAME_MIN_LEN] = { 0 };
+    uint8_t* replyArp = &reply[ETH_HEADER_LEN];
+
+    memcpy(&reply[0], &arp[8], ETH_ADDR_LEN);
+    memcpy(&reply[ETH_ADDR_LEN], peerMac, ETH_ADDR_LEN);
+    reply[ETH_TYPE_OFFSET]     = ETH_TYPE_ARP >> 8;
+    reply[ETH_TYPE_OFFSET + 1] = ETH_TYPE_ARP & 0xff;
+
+    // same hardware and protocol type and sizes as the request
+    memcpy(replyArp, arp, 6);
+    replyArp[7] = ARP_OPER_REPLY;
+    memcpy(&replyArp[8], peerMac, ETH_ADDR_LEN);
+    memcpy(&replyArp[14], peerIp, sizeof(peerIp));
+    memcpy(&replyArp[18], &arp[8], ETH_ADDR_LEN + 4);
+
+    NetworkStack_Host_receiveFrame(reply, sizeof(reply));
+}
+
+//------------------------------------------------------------------------------
+// The wire the stack's NIC is connected to. Frames to the peer address come
+// back with the Ethernet and IPv4 source and destination swapped, so for the
+// stack they come from the peer and are delivered to its own address. Both
+// ends of a connection are sockets of the same stack, but every frame passes
+// the NIC in both directions. Swapping keeps the IPv4, TCP and UDP checksums
+// valid. Everything else, e.g. broadcasts, is dropped.
+static void
+wire_tx_frame(
+    void*       ctx,
+    const void* frame,
+    size_t      len)
+{
+    const uint8_t* in = frame;
+
+    if (len < ETH_HEADER_LEN)
+    {
+        return;
+    }
+
+    const uint16_t ethType = (in[ETH_TYPE_OFFSET] << 8)
+                             | in[ETH_TYPE_OFFSET + 1];
+    if (ethType == ETH_TYPE_ARP)
+    {
+        wire_arp_reply(in, len);
+        return;
+    }
+
+    if ((ethType != ETH_TYPE_IPV4)
+        || (len < ETH_HEADER_LEN + IPV4_HEADER_MIN_LEN)
+        || (memcmp(&in[ETH_HEADER_LEN + IPV4_DST_OFFSET], peerIp,
+                   sizeof(peerIp)) != 0)
+        || (len > ETH_FRAME_MAX_LEN))
+    {
+        return;
+    }
+
+    uint8_t out[ETH_FRAME_MAX_LEN];
+    uint8_t* ip = &out[ETH_HEADER_LEN];
+
+    memcpy(out, in, len);
+    memcpy(&out[0], &in[ETH_ADDR_LEN], ETH_ADDR_LEN);
+    memcpy(&out[ETH_ADDR_LEN], peerMac, ETH_ADDR_LEN);
+    memcpy(&ip[IPV4_SRC_OFFSET], &in[ETH_HEADER_LEN + IPV4_DST_OFFSET], 4);
+    memcpy(&ip[IPV4_DST_OFFSET], &in[ETH_HEADER_LEN + IPV4_SRC_OFFSET], 4);
+
+    // a full receive queue drops the frame, like a real wire
+    if (NetworkStack_Host_receiveFrame(out, len) != OS_SUCCESS)
+    {
+        Debug_LOG_DEBUG("Wire dropped a frame of %zu bytes", len);
+    }
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_mode_from_env(
+    NetworkStack_Host_NicMode_t* pMode)
+{
+    static const struct
+    {
+        const char*                 name;
+        const char*                 pathName;
+        NetworkStack_Host_NicMode_t mode;
+    } modes[] =
+    {
+        { "event", "nic_event", NetworkStack_Host_NIC_EVENT },
+        { "batch", "nic_batch", NetworkStack_Host_NIC_BATCH },
+        { "ring",  "nic_ring",  NetworkStack_Host_NIC_RING },
+    };
+
+    const char* name = getenv("BENCHMARK_NIC_MODE");
+    if (NULL == name)
+    {
+        name = modes[0].name;
+    }
+
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (strcmp(name, modes[i].name) == 0)
+        {
+            *pMode = modes[i].mode;
+            nicPathName = modes[i].pathName;
+            return OS_SUCCESS;
+        }
+    }
+
+    Debug_LOG_ERROR("Unknown BENCHMARK_NIC_MODE '%s'", name);
+    return OS_ERROR_INVALID_PARAMETER;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_start(
+    const char* suite,
+    int         socketQuota)
+{
+    static const OS_NetworkStack_AddressConfig_t ipAddrConfig =
+    {
+        .dev_addr     = Benchmark_ADDR,
+        .gateway_addr = "10.0.0.1",
+        .subnet_mask  = "255.255.255.0"
+    };
+
+    NetworkStack_Host_Config_t hostConfig =
+    {
+        .number_of_clients = BENCHMARK_NUMBER_OF_CLIENTS,
+        .socket_quota      = socketQuota,
+        .client_buf_size   = Benchmark_CLIENT_DATAPORT_SIZE,
+        .mac               = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 },
+        .tx                = wire_tx_frame,
+        .tx_ctx            = NULL
+    };
+
+    suiteName = suite;
+
+    OS_Error_t ret = nic_mode_from_env(&hostConfig.nic_mode);
+    if (ret != OS_SUCCESS)
+    {
+        return ret;
+    }
+
+    if (inet_pton(AF_INET, Benchmark_PEER_ADDR, peerIp) != 1)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (int i = 0; i < BENCHMARK_NUMBER_OF_CLIENTS; i++)
+    {
+        for (int j = 0; j < PENDING_EVENTS_SLOTS; j++)
+        {
+            pendingEvents[i][j].handle = -1;
+        }
+    }
+
+    return NetworkStack_Host_start(&hostConfig, &ipAddrConfig);
+}
+
+//------------------------------------------------------------------------------
+void
+Benchmark_setPath(
+    Benchmark_Path_t path)
+{
+    currentPath = path;
+}
+
+//------------------------------------------------------------------------------
+const char*
+Benchmark_getPeerAddr(void)
+{
+    return (currentPath == Benchmark_PATH_NIC) ? Benchmark_PEER_ADDR
+           : Benchmark_ADDR;
+}
+
+//------------------------------------------------------------------------------
+uint64_t
+Benchmark_nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+static unsigned int
+pending_events_hash(
+    int handle)
+{
+    return (unsigned int)handle % PENDING_EVENTS_SLOTS;
+}
+
+//------------------------------------------------------------------------------
+// Returns the slot of the socket, or the empty slot it would go into. Returns
+// -1 if the socket has no slot and there is no empty one.
+static int
+pending_events_find(
+    int clientIndex,
+    int handle)
+{
+    unsigned int slot = pending_events_hash(handle);
+
+    for (int i = 0; i < PENDING_EVENTS_SLOTS; i++)
+    {
+        const int slotHandle = pendingEvents[clientIndex][slot].handle;
+        if ((slotHandle == handle) || (slotHandle < 0))
+        {
+            return slot;
+        }
+        slot = (slot + 1) % PENDING_EVENTS_SLOTS;
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+static void
+pending_events_add(
+    int      clientIndex,
+    int      handle,
+    uint16_t eventMask)
+{
+    const int slot = pending_events_find(clientIndex, handle);
+    if (slot < 0)
+    {
+        Debug_LOG_ERROR("No slot left for events of socket %d", handle);
+        return;
+    }
+
+    pendingEvents[clientIndex][slot].handle = handle;
+    pendingEvents[clientIndex][slot].eventMask |= eventMask;
+}
+
+//------------------------------------------------------------------------------
+static uint16_t
+pending_events_take(
+    int      clientIndex,
+    int      handle,
+    uint16_t mask)
+{
+    const int slot = pending_events_find(clientIndex, handle);
+    if ((slot < 0) || (pendingEvents[clientIndex][slot].handle != handle))
+    {
+        return 0;
+    }
+
+    const uint16_t events = pendingEvents[clientIndex][slot].eventMask & mask;
+    pendingEvents[clientIndex][slot].eventMask &= ~events;
+
+    return events;
+}
+
+//------------------------------------------------------------------------------
+// Frees the slot of a closed socket. The following slots of the same probe
+// sequence are moved up, so lookups never stop at the gap.
+static void
+pending_events_remove(
+    int clientIndex,
+    int handle)
+{
+    int hole = pending_events_find(clientIndex, handle);
+    if ((hole < 0) || (pendingEvents[clientIndex][hole].handle != handle))
+    {
+        return;
+    }
+
+    for (int i = (hole + 1) % PENDING_EVENTS_SLOTS;
+         pendingEvents[clientIndex][i].handle >= 0;
+         i = (i + 1) % PENDING_EVENTS_SLOTS)
+    {
+        const int home =
+            pending_events_hash(pendingEvents[clientIndex][i].handle);
+
+        // the entry may move to the hole if its home is not after the hole
+        const bool isMovable = (hole <= i) ? ((home <= hole) || (home > i))
+                               : ((home <= hole) && (home > i));
+        if (isMovable)
+        {
+            pendingEvents[clientIndex][hole] = pendingEvents[clientIndex][i];
+            hole = i;
+        }
+    }
+
+    pendingEvents[clientIndex][hole].handle = -1;
+    pendingEvents[clientIndex][hole].eventMask = 0;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_fetchEvents(
+    int     clientIndex,
+    size_t* pNumberOfEvents)
+{
+    NetworkStack_Host_setClient(clientIndex);
+
+    OS_Error_t ret = NetworkStack_Host_socket_getPendingEvents(
+                         Benchmark_CLIENT_DATAPORT_SIZE,
+                         pNumberOfEvents);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("getPendingEvents() failed, error %d", ret);
+        return ret;
+    }
+
+    const OS_Socket_Evt_t* events =
+        NetworkStack_Host_getClientBuf(clientIndex);
+
+    for (size_t i = 0; i < *pNumberOfEvents; i++)
+    {
+        pending_events_add(clientIndex, events[i].socketHandle,
+                           events[i].eventMask);
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_waitEvent(
+    int       clientIndex,
+    int       handle,
+    uint16_t  mask,
+    uint16_t* pEvents)
+{
+    mask |= OS_SOCK_EV_FIN | OS_SOCK_EV_CLOSE | OS_SOCK_EV_ERROR;
+
+    for (;;)
+    {
+        size_t     numberOfEvents;
+        OS_Error_t ret = Benchmark_fetchEvents(clientIndex, &numberOfEvents);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+
+        const uint16_t events = pending_events_take(clientIndex, handle, mask);
+        if (events)
+        {
+            *pEvents = events;
+            return OS_SUCCESS;
+        }
+
+        NetworkStack_Host_waitClientEvent(clientIndex);
+    }
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_listen(
+    int      clientIndex,
+    uint16_t port,
+    int      backlog,
+    int*     pHandle)
+{
+    const OS_Socket_Addr_t localAddr =
+    {
+        .addr = Benchmark_ADDR,
+        .port = port
+    };
+
+    NetworkStack_Host_setClient(clientIndex);
+
+    OS_Error_t ret = NetworkStack_Host_socket_create(OS_AF_INET, OS_SOCK_STREAM,
+                                                    pHandle);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_create() failed, error %d", ret);
+        return ret;
+    }
+
+    ret = NetworkStack_Host_socket_bind(*pHandle, &localAddr);
+    if (ret == OS_SUCCESS)
+    {
+        ret = NetworkStack_Host_socket_listen(*pHandle, backlog);
+    }
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Failed to listen on port %u, error %d", port, ret);
+        Benchmark_close(clientIndex, *pHandle);
+        return ret;
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_bindUdp(
+    int      clientIndex,
+    uint16_t port,
+    int*     pHandle)
+{
+    const OS_Socket_Addr_t localAddr =
+    {
+        .addr = Benchmark_ADDR,
+        .port = port
+    };
+
+    NetworkStack_Host_setClient(clientIndex);
+
+    OS_Error_t ret = NetworkStack_Host_socket_create(OS_AF_INET, OS_SOCK_DGRAM,
+                                                    pHandle);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_create() failed, error %d", ret);
+        return ret;
+    }
+
+    ret = NetworkStack_Host_socket_bind(*pHandle, &localAddr);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_bind() failed, error %d", ret);
+        Benchmark_close(clientIndex, *pHandle);
+        return ret;
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_connect(
+    int      clientIndex,
+    uint16_t port,
+    int*     pHandle)
+{
+    OS_Socket_Addr_t dstAddr =
+    {
+        .port = port
+    };
+    strncpy(dstAddr.addr, Benchmark_getPeerAddr(), sizeof(dstAddr.addr) - 1);
+
+    NetworkStack_Host_setClient(clientIndex);
+
+    OS_Error_t ret = NetworkStack_Host_socket_create(OS_AF_INET, OS_SOCK_STREAM,
+                                                    pHandle);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_create() failed, error %d", ret);
+        return ret;
+    }
+
+    ret = NetworkStack_Host_socket_connect(*pHandle, &dstAddr);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_connect() failed, error %d", ret);
+        Benchmark_close(clientIndex, *pHandle);
+        return ret;
+    }
+
+    uint16_t events;
+    ret = Benchmark_waitEvent(clientIndex, *pHandle, OS_SOCK_EV_CONN_EST,
+                              &events);
+    if ((ret == OS_SUCCESS) && !(events & OS_SOCK_EV_CONN_EST))
+    {
+        ret = OS_ERROR_NETWORK_CONN_REFUSED;
+    }
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Connection to port %u failed, error %d", port, ret);
+        Benchmark_close(clientIndex, *pHandle);
+        return ret;
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_accept(
+    int  clientIndex,
+    int  listenHandle,
+    int* pHandle)
+{
+    for (;;)
+    {
+        OS_Socket_Addr_t srcAddr;
+
+        NetworkStack_Host_setClient(clientIndex);
+
+        OS_Error_t ret = NetworkStack_Host_socket_accept(listenHandle, pHandle,
+                                                        &srcAddr);
+        if (ret != OS_ERROR_TRY_AGAIN)
+        {
+            return ret;
+        }
+
+        uint16_t events;
+        ret = Benchmark_waitEvent(clientIndex, listenHandle,
+                                  OS_SOCK_EV_CONN_ACPT, &events);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+Benchmark_close(
+    int clientIndex,
+    int handle)
+{
+    NetworkStack_Host_setClient(clientIndex);
+
+    // forget the events of the socket, the handle may be handed out again
+    pending_events_remove(clientIndex, handle);
+
+    return NetworkStack_Host_socket_close(handle);
+}
+
+//------------------------------------------------------------------------------
+void
+Benchmark_emit(
+    const char* test,
+    size_t      param,
+    const char* metric,
+    double      value,
+    const char* unit)
+{
+    const char* path = (currentPath == Benchmark_PATH_NIC) ? nicPathName
+                       : "loopback";
+
+    printf("{\"suite\":\"%s\",\"path\":\"%s\",\"test\":\"%s\","
+           "\"param\":%zu,\"metric\":\"%s\",\"value\":%.3f,"
+           "\"unit\":\"%s\"}\n",
+           suiteName, path, test, param, metric, value, unit);
+    fflush(stdout);
+}
+
+//------------------------------------------------------------------------------
+static int
+compare_samples(
+    const void* a,
+    const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+//------------------------------------------------------------------------------
+void
+Benchmark_emitLatency(
+    const char* test,
+    size_t      param,
+    const char* operation,
+    uint64_t*   samples,
+    size_t      numberOfSamples)
+{
+    static const struct
+    {
+        const char* name;
+        unsigned int permille;
+    } percentiles[] =
+    {
+        { "p50", 500 },
+        { "p90", 900 },
+        { "p99", 990 },
+        { "max", 1000 },
+    };
+
+    if (0 == numberOfSamples)
+    {
+        return;
+    }
+
+    qsort(samples, numberOfSamples, sizeof(*samples), compare_samples);
+
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    {
+        char metric[64];
+        snprintf(metric, sizeof(metric), "%s_%s", operation,
+                 percentiles[i].name);
+
+        size_t pos = (numberOfSamples * percentiles[i].permille) / 1000;
+        if (pos >= numberOfSamples)
+        {
+            pos = numberOfSamples - 1;
+        }
+
+        Benchmark_emit(test, param, metric, (double)samples[pos], "ns");
+    }
+}
@@ -0,0 +1,171 @@
+/*
+ * Network Stack benchmarks, common functions
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * The benchmarks run the network stack in the host environment, see
+ * network_stack_host.h, and call the NetworkStack_Host_socket_xxx() functions
+ * the way a client does. The remote end is a local peer stand-in: a second
+ * client of the same stack. It is reached on one of two paths:
+ *
+ * - Benchmark_PATH_NIC: the stack talks to Benchmark_PEER_ADDR. The frames go
+ *   out through the NIC stand-in, the wire reflects them back as if they came
+ *   from that address, and they come in through the NIC again. The driver
+ *   interface is selected with the environment variable BENCHMARK_NIC_MODE,
+ *   which is "event" (default), "batch" or "ring".
+ * - Benchmark_PATH_LOOPBACK: the stack talks to its own address, picoTCP
+ *   delivers the frames internally without the NIC.
+ *
+ * Results are written to stdout as one JSON object per line, e.g.
+ *
+ *   {"suite":"datapath","path":"nic_batch","test":"tcp_stream","param":1024,
+ *    "metric":"throughput","value":123.4,"unit":"MiB/s"}
+ *
+ * so runs of different builds can be compared by a script.
+ */
+
+#pragma once
+
+#include "OS_Error.h"
+#include "OS_Socket.h"
+
+#include "network_stack_config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// largest payload of a single call
+#define Benchmark_CLIENT_BUF_SIZE   4096
+
+// The client dataports also hold the events of all sockets, so a single
+// getPendingEvents() call reports all of them.
+#define Benchmark_CLIENT_DATAPORT_SIZE                                         \
+    ((NetworkStack_PicoTcp_MAX_SOCKETS * sizeof(OS_Socket_Evt_t)               \
+      > Benchmark_CLIENT_BUF_SIZE)                                             \
+     ? NetworkStack_PicoTcp_MAX_SOCKETS * sizeof(OS_Socket_Evt_t)              \
+     : Benchmark_CLIENT_BUF_SIZE)
+
+#define Benchmark_ADDR              "10.0.0.10"
+#define Benchmark_PEER_ADDR         "10.0.0.20"
+#define Benchmark_PORT              5555
+
+// client indices of the host environment
+#define Benchmark_CLIENT_LOCAL      0
+#define Benchmark_CLIENT_PEER       1
+
+typedef enum
+{
+    Benchmark_PATH_LOOPBACK,
+    Benchmark_PATH_NIC
+} Benchmark_Path_t;
+
+/**
+ * Starts the network stack, the path is Benchmark_PATH_LOOPBACK.
+ */
+OS_Error_t
+Benchmark_start(
+    const char* suite,
+    int         socketQuota);
+
+/**
+ * Selects the path of the following connections and datagrams, and the path
+ * reported with the results.
+ */
+void
+Benchmark_setPath(
+    Benchmark_Path_t path);
+
+/**
+ * Returns the address the peer is reached at on the current path.
+ */
+const char*
+Benchmark_getPeerAddr(void);
+
+uint64_t
+Benchmark_nowNs(void);
+
+/**
+ * Blocks until the socket has one of the events in mask, or FIN, CLOSE or
+ * ERROR. Events of other sockets of the client fetched meanwhile are kept for
+ * later calls.
+ */
+OS_Error_t
+Benchmark_waitEvent(
+    int       clientIndex,
+    int       handle,
+    uint16_t  mask,
+    uint16_t* pEvents);
+
+/**
+ * Fetches the pending events of the client once, keeping them for
+ * Benchmark_waitEvent().
+ */
+OS_Error_t
+Benchmark_fetchEvents(
+    int     clientIndex,
+    size_t* pNumberOfEvents);
+
+OS_Error_t
+Benchmark_listen(
+    int      clientIndex,
+    uint16_t port,
+    int      backlog,
+    int*     pHandle);
+
+/**
+ * Creates a UDP socket bound to the stack's own address and the port.
+ */
+OS_Error_t
+Benchmark_bindUdp(
+    int      clientIndex,
+    uint16_t port,
+    int*     pHandle);
+
+/**
+ * Connects to the peer address of the current path and waits until the
+ * connection is established.
+ */
+OS_Error_t
+Benchmark_connect(
+    int      clientIndex,
+    uint16_t port,
+    int*     pHandle);
+
+/**
+ * Accepts a connection, waiting for it if there is none yet.
+ */
+OS_Error_t
+Benchmark_accept(
+    int  clientIndex,
+    int  listenHandle,
+    int* pHandle);
+
+OS_Error_t
+Benchmark_close(
+    int clientIndex,
+    int handle);
+
+void
+Benchmark_emit(
+    const char* test,
+    size_t      param,
+    const char* metric,
+    double      value,
+    const char* unit);
+
+/**
+ * Emits the percentiles of the latency samples in ns, sorting them.
+ */
+void
+Benchmark_emitLatency(
+    const char* test,
+    size_t      param,
+    const char* operation,
+    uint64_t*   samples,
+    size_t      numberOfSamples);
@@ -0,0 +1,486 @@
+/*
+ * Network Stack data path benchmark
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Measures TCP stream throughput, UDP datagram rate and the per-call latency
+ * of socket_write() and socket_read() for several payload sizes up to the
+ * client dataport size. The local client sends, the peer stand-in receives in
+ * its own thread. Every test runs over the NIC path first, then over the
+ * loopback path for comparison, see benchmark_common.h.
+ */
+
+#include "benchmark_common.h"
+
+#include "network_stack_host.h"
+
+#include "lib_debug/Debug.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TCP_STREAM_BYTES        (4 * 1024 * 1024)
+#define UDP_DATAGRAMS           20000
+
+// calls beyond this are not part of the latency percentiles
+#define LATENCY_SAMPLES_MAX     (TCP_STREAM_BYTES / 64)
+
+// first byte of the datagram that ends a UDP run
+#define UDP_END_MARKER          0xff
+
+static const size_t tcpPayloadSizes[] =
+{
+    64, 256, 1024, Benchmark_CLIENT_BUF_SIZE
+};
+
+// keep datagrams within one ethernet frame
+static const size_t udpPayloadSizes[] =
+{
+    64, 256, 1024, 1472
+};
+
+typedef struct
+{
+    int        handle;
+    size_t     payload;
+    size_t     total;
+    uint64_t*  samples;
+    size_t     numberOfSamples;
+    uint64_t   endNs;
+    OS_Error_t ret;
+} StreamReader_t;
+
+typedef struct
+{
+    int         handle;
+    size_t      payload;
+    size_t      received;
+    atomic_bool isDone;
+    OS_Error_t  ret;
+} DatagramReader_t;
+
+//------------------------------------------------------------------------------
+static void*
+tcp_stream_reader(
+    void* arg)
+{
+    StreamReader_t* reader = arg;
+    size_t received = 0;
+
+    NetworkStack_Host_setClient(Benchmark_CLIENT_PEER);
+
+    while (received < reader->total)
+    {
+        size_t len = reader->payload;
+
+        const uint64_t start = Benchmark_nowNs();
+        OS_Error_t ret = NetworkStack_Host_socket_read(reader->handle, &len);
+        const uint64_t end = Benchmark_nowNs();
+
+        if (ret == OS_SUCCESS)
+        {
+            if (reader->numberOfSamples < LATENCY_SAMPLES_MAX)
+            {
+                reader->samples[reader->numberOfSamples++] = end - start;
+            }
+            received += len;
+        }
+        else if (ret == OS_ERROR_TRY_AGAIN)
+        {
+            uint16_t events;
+            ret = Benchmark_waitEvent(Benchmark_CLIENT_PEER, reader->handle,
+                                      OS_SOCK_EV_READ, &events);
+            NetworkStack_Host_setClient(Benchmark_CLIENT_PEER);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Reading failed after %zu bytes, error %d",
+                            received, ret);
+            reader->ret = ret;
+            return NULL;
+        }
+    }
+
+    reader->endNs = Benchmark_nowNs();
+    reader->ret = OS_SUCCESS;
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+tcp_stream_run(
+    int    listenHandle,
+    size_t payload)
+{
+    uint64_t* writeSamples = calloc(LATENCY_SAMPLES_MAX, sizeof(uint64_t));
+    uint64_t* readSamples = calloc(LATENCY_SAMPLES_MAX, sizeof(uint64_t));
+    size_t numberOfWriteSamples = 0;
+    int localHandle = -1;
+    int peerHandle = -1;
+    pthread_t thread;
+
+    OS_Error_t ret = OS_ERROR_INSUFFICIENT_SPACE;
+    if ((NULL == writeSamples) || (NULL == readSamples))
+    {
+        goto exit;
+    }
+
+    ret = Benchmark_connect(Benchmark_CLIENT_PEER, Benchmark_PORT, &peerHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    ret = Benchmark_accept(Benchmark_CLIENT_LOCAL, listenHandle, &localHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    StreamReader_t reader =
+    {
+        .handle  = peerHandle,
+        .payload = payload,
+        .total   = TCP_STREAM_BYTES,
+        .samples = readSamples
+    };
+
+    const uint64_t startNs = Benchmark_nowNs();
+
+    if (pthread_create(&thread, NULL, tcp_stream_reader, &reader) != 0)
+    {
+        ret = OS_ERROR_GENERIC;
+        goto exit;
+    }
+
+    uint8_t* buf = NetworkStack_Host_getClientBuf(Benchmark_CLIENT_LOCAL);
+    memset(buf, 0xa5, payload);
+
+    size_t sent = 0;
+    while (sent < TCP_STREAM_BYTES)
+    {
+        size_t len = TCP_STREAM_BYTES - sent;
+        if (len > payload)
+        {
+            len = payload;
+        }
+
+        NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+        const uint64_t start = Benchmark_nowNs();
+        ret = NetworkStack_Host_socket_write(localHandle, &len);
+        const uint64_t end = Benchmark_nowNs();
+
+        if ((ret == OS_SUCCESS) && (len > 0))
+        {
+            if (numberOfWriteSamples < LATENCY_SAMPLES_MAX)
+            {
+                writeSamples[numberOfWriteSamples++] = end - start;
+            }
+            sent += len;
+            continue;
+        }
+
+        if ((ret == OS_SUCCESS) || (ret == OS_ERROR_TRY_AGAIN))
+        {
+            // socket buffer full, wait until picoTCP has space again
+            uint16_t events;
+            ret = Benchmark_waitEvent(Benchmark_CLIENT_LOCAL, localHandle,
+                                      OS_SOCK_EV_WRITE, &events);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Writing failed after %zu bytes, error %d",
+                            sent, ret);
+            break;
+        }
+    }
+
+    pthread_join(thread, NULL);
+
+    if ((ret == OS_SUCCESS) && (reader.ret != OS_SUCCESS))
+    {
+        ret = reader.ret;
+    }
+
+    if (ret == OS_SUCCESS)
+    {
+        const double seconds = (double)(reader.endNs - startNs) / 1e9;
+
+        Benchmark_emit("tcp_stream", payload, "throughput",
+                       TCP_STREAM_BYTES / seconds / (1024 * 1024), "MiB/s");
+        Benchmark_emitLatency("tcp_stream", payload, "write", writeSamples,
+                              numberOfWriteSamples);
+        Benchmark_emitLatency("tcp_stream", payload, "read", readSamples,
+                              reader.numberOfSamples);
+    }
+
+exit:
+    if (localHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, localHandle);
+    }
+    if (peerHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_PEER, peerHandle);
+    }
+    free(writeSamples);
+    free(readSamples);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+static void*
+udp_datagram_reader(
+    void* arg)
+{
+    DatagramReader_t* reader = arg;
+    const uint8_t* buf = NetworkStack_Host_getClientBuf(Benchmark_CLIENT_PEER);
+
+    for (;;)
+    {
+        OS_Socket_Addr_t srcAddr;
+        size_t len = reader->payload;
+
+        NetworkStack_Host_setClient(Benchmark_CLIENT_PEER);
+
+        OS_Error_t ret = NetworkStack_Host_socket_recvfrom(reader->handle, &len,
+                                                          &srcAddr);
+        if (ret == OS_SUCCESS)
+        {
+            if ((len > 0) && (UDP_END_MARKER == buf[0]))
+            {
+                break;
+            }
+            reader->received++;
+            continue;
+        }
+
+        if (ret == OS_ERROR_TRY_AGAIN)
+        {
+            uint16_t events;
+            ret = Benchmark_waitEvent(Benchmark_CLIENT_PEER, reader->handle,
+                                      OS_SOCK_EV_READ, &events);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Receiving failed, error %d", ret);
+            reader->ret = ret;
+            atomic_store(&reader->isDone, true);
+            return NULL;
+        }
+    }
+
+    reader->ret = OS_SUCCESS;
+    atomic_store(&reader->isDone, true);
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+udp_datagram_run(
+    size_t payload)
+{
+    OS_Socket_Addr_t dstAddr =
+    {
+        .port = Benchmark_PORT
+    };
+    int localHandle = -1;
+    pthread_t thread;
+
+    DatagramReader_t reader =
+    {
+        .handle  = -1,
+        .payload = payload
+    };
+    atomic_init(&reader.isDone, false);
+
+    strncpy(dstAddr.addr, Benchmark_getPeerAddr(), sizeof(dstAddr.addr) - 1);
+
+    OS_Error_t ret = Benchmark_bindUdp(Benchmark_CLIENT_PEER, Benchmark_PORT,
+                                       &reader.handle);
+    if (ret != OS_SUCCESS)
+    {
+        return ret;
+    }
+
+    ret = Benchmark_bindUdp(Benchmark_CLIENT_LOCAL, Benchmark_PORT + 1,
+                            &localHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    uint64_t* samples = calloc(UDP_DATAGRAMS, sizeof(uint64_t));
+    if (NULL == samples)
+    {
+        ret = OS_ERROR_INSUFFICIENT_SPACE;
+        goto exit;
+    }
+
+    if (pthread_create(&thread, NULL, udp_datagram_reader, &reader) != 0)
+    {
+        free(samples);
+        ret = OS_ERROR_GENERIC;
+        goto exit;
+    }
+
+    uint8_t* buf = NetworkStack_Host_getClientBuf(Benchmark_CLIENT_LOCAL);
+    size_t sent = 0;
+
+    NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+    const uint64_t startNs = Benchmark_nowNs();
+
+    while (sent < UDP_DATAGRAMS)
+    {
+        size_t len = payload;
+        memset(buf, 0, payload);
+
+        const uint64_t start = Benchmark_nowNs();
+        ret = NetworkStack_Host_socket_sendto(localHandle, &len, &dstAddr);
+        const uint64_t end = Benchmark_nowNs();
+
+        if (ret == OS_SUCCESS)
+        {
+            samples[sent++] = end - start;
+        }
+        else if (ret == OS_ERROR_TRY_AGAIN)
+        {
+            sched_yield();
+        }
+        else
+        {
+            Debug_LOG_ERROR("socket_sendto() failed, error %d", ret);
+            break;
+        }
+    }
+
+    const uint64_t endNs = Benchmark_nowNs();
+
+    // Datagrams may get lost, so repeat the end marker until the reader saw
+    // one of them.
+    while (!atomic_load(&reader.isDone))
+    {
+        size_t len = 1;
+        buf[0] = UDP_END_MARKER;
+        NetworkStack_Host_socket_sendto(localHandle, &len, &dstAddr);
+        usleep(1000);
+    }
+
+    pthread_join(thread, NULL);
+
+    if ((ret == OS_SUCCESS) && (reader.ret != OS_SUCCESS))
+    {
+        ret = reader.ret;
+    }
+
+    if (ret == OS_SUCCESS)
+    {
+        const double seconds = (double)(endNs - startNs) / 1e9;
+
+        Benchmark_emit("udp_datagram", payload, "send_rate",
+                       sent / seconds, "datagrams/s");
+        Benchmark_emit("udp_datagram", payload, "delivered",
+                       100.0 * reader.received / sent, "%");
+        Benchmark_emitLatency("udp_datagram", payload, "sendto", samples,
+                              sent);
+    }
+
+    free(samples);
+
+exit:
+    if (localHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, localHandle);
+    }
+    Benchmark_close(Benchmark_CLIENT_PEER, reader.handle);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+datapath_run(void)
+{
+    int listenHandle;
+
+    OS_Error_t ret = Benchmark_listen(Benchmark_CLIENT_LOCAL, Benchmark_PORT, 1,
+                           &listenHandle);
+    if (ret != OS_SUCCESS)
+    {
+        return ret;
+    }
+
+    for (size_t i = 0; i < sizeof(tcpPayloadSizes) / sizeof(tcpPayloadSizes[0]);
+         i++)
+    {
+        ret = tcp_stream_run(listenHandle, tcpPayloadSizes[i]);
+        if (ret != OS_SUCCESS)
+        {
+            Benchmark_close(Benchmark_CLIENT_LOCAL, listenHandle);
+            return ret;
+        }
+    }
+
+    Benchmark_close(Benchmark_CLIENT_LOCAL, listenHandle);
+
+    for (size_t i = 0; i < sizeof(udpPayloadSizes) / sizeof(udpPayloadSizes[0]);
+         i++)
+    {
+        ret = udp_datagram_run(udpPayloadSizes[i]);
+        if (ret != OS_SUCCESS)
+        {
+            return ret;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+int
+main(void)
+{
+    static const Benchmark_Path_t paths[] =
+    {
+        Benchmark_PATH_NIC, Benchmark_PATH_LOOPBACK
+    };
+
+    OS_Error_t ret = Benchmark_start("datapath",
+                                     NetworkStack_PicoTcp_MAX_SOCKETS);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Benchmark_start() failed, error %d", ret);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+    {
+        Benchmark_setPath(paths[i]);
+
+        if (datapath_run() != OS_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*
+ * Network Stack socket event dispatch benchmark
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Measures how the cost of dispatching a picoTCP socket event to its handle
+ * depends on the number of open sockets. For 16, 256 and 4096 open sockets, the
+ * peer stand-in sends single datagrams to the local client, which waits for
+ * each of them and reads it. Every datagram raises picoTCP events on the
+ * sending and the receiving socket, which the stack maps to their handles.
+ *
+ * Apart from the sender and the receiver, the open sockets are idle UDP sockets
+ * of the local client. The receiver is opened last, so it gets the highest
+ * socket table index. Counts above the number of sockets of the host library
+ * are skipped, see NetworkStack_PicoTcp_DeclareHostLibrary().
+ */
+
+#include "benchmark_common.h"
+
+#include "network_stack_host.h"
+
+#include "lib_debug/Debug.h"
+
+#include <stdlib.h>
+
+#define DISPATCH_ROUNDS         10000
+
+// port of the first idle socket, the others follow
+#define IDLE_PORT_BASE          10000
+
+static const int socketCounts[] =
+{
+    16, 256, 4096
+};
+
+static int idleHandles[NetworkStack_PicoTcp_MAX_SOCKETS];
+
+static uint64_t samples[DISPATCH_ROUNDS];
+
+//------------------------------------------------------------------------------
+// sends one datagram from the peer and waits until the local client read it
+static OS_Error_t
+dispatch_round(
+    int senderHandle,
+    int receiverHandle)
+{
+    static const OS_Socket_Addr_t dstAddr =
+    {
+        .addr = Benchmark_ADDR,
+        .port = Benchmark_PORT
+    };
+    size_t len = 1;
+
+    NetworkStack_Host_setClient(Benchmark_CLIENT_PEER);
+
+    OS_Error_t ret = NetworkStack_Host_socket_sendto(senderHandle, &len,
+                                                    &dstAddr);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("socket_sendto() failed, error %d", ret);
+        return ret;
+    }
+
+    for (;;)
+    {
+        OS_Socket_Addr_t srcAddr;
+        len = 1;
+
+        NetworkStack_Host_setClient(Benchmark_CLIENT_LOCAL);
+
+        ret = NetworkStack_Host_socket_recvfrom(receiverHandle, &len,
+                                                &srcAddr);
+        if (ret != OS_ERROR_TRY_AGAIN)
+        {
+            break;
+        }
+
+        uint16_t events;
+        ret = Benchmark_waitEvent(Benchmark_CLIENT_LOCAL, receiverHandle,
+                                  OS_SOCK_EV_READ, &events);
+        if (ret != OS_SUCCESS)
+        {
+            break;
+        }
+    }
+
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Receiving failed, error %d", ret);
+    }
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+dispatch_run(
+    int n)
+{
+    // the sender and the receiver are open sockets, too
+    const int idleSockets = n - 2;
+    int openedIdle = 0;
+    int senderHandle = -1;
+    int receiverHandle = -1;
+
+    OS_Error_t ret = Benchmark_bindUdp(Benchmark_CLIENT_PEER,
+                                       Benchmark_PORT + 1, &senderHandle);
+    if (ret != OS_SUCCESS)
+    {
+        return ret;
+    }
+
+    for (; openedIdle < idleSockets; openedIdle++)
+    {
+        ret = Benchmark_bindUdp(Benchmark_CLIENT_LOCAL,
+                                IDLE_PORT_BASE + openedIdle,
+                                &idleHandles[openedIdle]);
+        if (ret != OS_SUCCESS)
+        {
+            goto exit;
+        }
+    }
+
+    ret = Benchmark_bindUdp(Benchmark_CLIENT_LOCAL, Benchmark_PORT,
+                            &receiverHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    const uint64_t startNs = Benchmark_nowNs();
+
+    for (int i = 0; i < DISPATCH_ROUNDS; i++)
+    {
+        const uint64_t start = Benchmark_nowNs();
+        ret = dispatch_round(senderHandle, receiverHandle);
+        samples[i] = Benchmark_nowNs() - start;
+
+        if (ret != OS_SUCCESS)
+        {
+            goto exit;
+        }
+    }
+
+    const double seconds = (double)(Benchmark_nowNs() - startNs) / 1e9;
+
+    Benchmark_emit("dispatch", n, "delivery_rate", DISPATCH_ROUNDS / seconds,
+                   "datagrams/s");
+    Benchmark_emitLatency("dispatch", n, "delivery", samples,
+                          DISPATCH_ROUNDS);
+
+exit:
+    if (receiverHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, receiverHandle);
+    }
+    for (int i = 0; i < openedIdle; i++)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, idleHandles[i]);
+    }
+    Benchmark_close(Benchmark_CLIENT_PEER, senderHandle);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+int
+main(void)
+{
+    OS_Error_t ret = Benchmark_start("dispatch",
+                                     NetworkStack_PicoTcp_MAX_SOCKETS);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Benchmark_start() failed, error %d", ret);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(socketCounts) / sizeof(socketCounts[0]); i++)
+    {
+        if (socketCounts[i] > NetworkStack_PicoTcp_MAX_SOCKETS)
+        {
+            Debug_LOG_WARNING("Skipping %d sockets, the stack has %d",
+                              socketCounts[i],
+                              NetworkStack_PicoTcp_MAX_SOCKETS);
+            continue;
+        }
+
+        if (dispatch_run(socketCounts[i]) != OS_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
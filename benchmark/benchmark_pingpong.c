@@ -0,0 +1,308 @@
+/*
+ * Network Stack request/response benchmark
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Measures the round trip time of a TCP ping-pong for several payload sizes.
+ * The local client writes a message and waits for it to come back, the peer
+ * stand-in echoes every message in its own thread. Each round trip takes two
+ * writes and two reads, so the time until the stack transmits queued data
+ * shows up twice, e.g. compare builds with and without the C flag
+ * NetworkStack_PicoTcp_USE_INLINE_TX. The messages take the NIC path, see
+ * benchmark_common.h, as only there the frames go to the driver.
+ */
+
+#include "benchmark_common.h"
+
+#include "network_stack_host.h"
+
+#include "lib_debug/Debug.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PINGPONG_ROUNDS         10000
+
+// round trips before the measurement starts
+#define PINGPONG_WARMUP_ROUNDS  100
+
+static const size_t payloadSizes[] =
+{
+    1, 64, 1024, Benchmark_CLIENT_BUF_SIZE
+};
+
+typedef struct
+{
+    int        handle;
+    size_t     payload;
+    size_t     rounds;
+    OS_Error_t ret;
+} Echo_t;
+
+//------------------------------------------------------------------------------
+// reads exactly len bytes, the content does not matter, so every chunk goes to
+// the start of the client dataport
+static OS_Error_t
+read_message(
+    int    clientIndex,
+    int    handle,
+    size_t len)
+{
+    size_t received = 0;
+
+    while (received < len)
+    {
+        size_t chunk = len - received;
+
+        NetworkStack_Host_setClient(clientIndex);
+
+        OS_Error_t ret = NetworkStack_Host_socket_read(handle, &chunk);
+        if ((ret == OS_SUCCESS) && (chunk > 0))
+        {
+            received += chunk;
+            continue;
+        }
+
+        if ((ret == OS_SUCCESS) || (ret == OS_ERROR_TRY_AGAIN))
+        {
+            uint16_t events;
+            ret = Benchmark_waitEvent(clientIndex, handle, OS_SOCK_EV_READ,
+                                      &events);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Reading failed after %zu bytes, error %d",
+                            received, ret);
+            return ret;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// writes len bytes from the start of the client dataport
+static OS_Error_t
+write_message(
+    int    clientIndex,
+    int    handle,
+    size_t len)
+{
+    size_t sent = 0;
+
+    while (sent < len)
+    {
+        size_t chunk = len - sent;
+
+        NetworkStack_Host_setClient(clientIndex);
+
+        OS_Error_t ret = NetworkStack_Host_socket_write(handle, &chunk);
+        if ((ret == OS_SUCCESS) && (chunk > 0))
+        {
+            sent += chunk;
+            continue;
+        }
+
+        if ((ret == OS_SUCCESS) || (ret == OS_ERROR_TRY_AGAIN))
+        {
+            uint16_t events;
+            ret = Benchmark_waitEvent(clientIndex, handle, OS_SOCK_EV_WRITE,
+                                      &events);
+        }
+
+        if (ret != OS_SUCCESS)
+        {
+            Debug_LOG_ERROR("Writing failed after %zu bytes, error %d",
+                            sent, ret);
+            return ret;
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static void*
+echo_thread(
+    void* arg)
+{
+    Echo_t* echo = arg;
+
+    for (size_t i = 0; i < echo->rounds; i++)
+    {
+        // the message is sent back from the dataport it was read into
+        echo->ret = read_message(Benchmark_CLIENT_PEER, echo->handle,
+                                 echo->payload);
+        if (echo->ret != OS_SUCCESS)
+        {
+            return NULL;
+        }
+
+        echo->ret = write_message(Benchmark_CLIENT_PEER, echo->handle,
+                                  echo->payload);
+        if (echo->ret != OS_SUCCESS)
+        {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+pingpong_run(
+    int    listenHandle,
+    size_t payload)
+{
+    int localHandle = -1;
+    int peerHandle = -1;
+    pthread_t thread;
+
+    uint64_t* samples = calloc(PINGPONG_ROUNDS, sizeof(uint64_t));
+    if (NULL == samples)
+    {
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    OS_Error_t ret = Benchmark_connect(Benchmark_CLIENT_PEER, Benchmark_PORT,
+                                       &peerHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    ret = Benchmark_accept(Benchmark_CLIENT_LOCAL, listenHandle, &localHandle);
+    if (ret != OS_SUCCESS)
+    {
+        goto exit;
+    }
+
+    Echo_t echo =
+    {
+        .handle  = peerHandle,
+        .payload = payload,
+        .rounds  = PINGPONG_WARMUP_ROUNDS + PINGPONG_ROUNDS,
+        .ret     = OS_SUCCESS
+    };
+
+    if (pthread_create(&thread, NULL, echo_thread, &echo) != 0)
+    {
+        ret = OS_ERROR_GENERIC;
+        goto exit;
+    }
+
+    uint8_t* buf = NetworkStack_Host_getClientBuf(Benchmark_CLIENT_LOCAL);
+    uint64_t startNs = 0;
+
+    for (size_t i = 0; i < echo.rounds; i++)
+    {
+        if (PINGPONG_WARMUP_ROUNDS == i)
+        {
+            startNs = Benchmark_nowNs();
+        }
+
+        memset(buf, (uint8_t)i, payload);
+
+        const uint64_t start = Benchmark_nowNs();
+        ret = write_message(Benchmark_CLIENT_LOCAL, localHandle, payload);
+        if (ret == OS_SUCCESS)
+        {
+            ret = read_message(Benchmark_CLIENT_LOCAL, localHandle, payload);
+        }
+        const uint64_t end = Benchmark_nowNs();
+
+        if (ret != OS_SUCCESS)
+        {
+            break;
+        }
+
+        if (i >= PINGPONG_WARMUP_ROUNDS)
+        {
+            samples[i - PINGPONG_WARMUP_ROUNDS] = end - start;
+        }
+    }
+
+    const uint64_t endNs = Benchmark_nowNs();
+
+    // on an error, the peer sees the connection closed and the echo ends
+    if (ret != OS_SUCCESS)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, localHandle);
+        localHandle = -1;
+    }
+
+    pthread_join(thread, NULL);
+
+    if (ret == OS_SUCCESS)
+    {
+        ret = echo.ret;
+    }
+
+    if (ret == OS_SUCCESS)
+    {
+        const double seconds = (double)(endNs - startNs) / 1e9;
+
+        Benchmark_emit("tcp_pingpong", payload, "exchange_rate",
+                       PINGPONG_ROUNDS / seconds, "exchanges/s");
+        Benchmark_emitLatency("tcp_pingpong", payload, "round_trip", samples,
+                              PINGPONG_ROUNDS);
+    }
+
+exit:
+    if (localHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_LOCAL, localHandle);
+    }
+    if (peerHandle >= 0)
+    {
+        Benchmark_close(Benchmark_CLIENT_PEER, peerHandle);
+    }
+    free(samples);
+
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+int
+main(void)
+{
+    int listenHandle;
+
+    OS_Error_t ret = Benchmark_start("pingpong",
+                                     NetworkStack_PicoTcp_MAX_SOCKETS);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("Benchmark_start() failed, error %d", ret);
+        return EXIT_FAILURE;
+    }
+
+    Benchmark_setPath(Benchmark_PATH_NIC);
+
+    ret = Benchmark_listen(Benchmark_CLIENT_LOCAL, Benchmark_PORT, 1,
+                           &listenHandle);
+    if (ret != OS_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(payloadSizes) / sizeof(payloadSizes[0]); i++)
+    {
+        if (pingpong_run(listenHandle, payloadSizes[i]) != OS_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    Benchmark_close(Benchmark_CLIENT_LOCAL, listenHandle);
+
+    return EXIT_SUCCESS;
+}
@@ -8,13 +8,198 @@
 
 #pragma once
 
+#include "OS_Dataport.h"
 #include "OS_Error.h"
 #include "OS_Socket.h"
 
+#include <stdint.h>
+
+// Maximum number of clients and sockets reported by getStatistics()
+#define NetworkStack_PicoTcp_STATISTICS_MAX_CLIENTS  8
+#define NetworkStack_PicoTcp_STATISTICS_MAX_SOCKETS  OS_NETWORK_MAXIMUM_SOCKET_NO
+
+typedef enum
+{
+    NetworkStack_PicoTcp_RX_MODE_EVENT,     // woken up by the driver
+    NetworkStack_PicoTcp_RX_MODE_BUSY_POLL, // polling without waiting
+} NetworkStack_PicoTcp_RxMode_t;
+
+typedef struct
+{
+    uint64_t rxFrames;
+    uint64_t rxBytes;
+    uint64_t rxDropped;          // not taken by picoTCP or invalid
+    uint64_t txFrames;
+    uint64_t txBytes;
+    uint64_t txDropped;          // rejected by the driver
+    uint64_t txRetries;          // driver returned OS_ERROR_TRY_AGAIN
+    uint64_t loopScoreExhausted; // polls that left frames in the driver
+    uint64_t busyPollWindows;    // switches from event driven to busy polling
+    // batched driver calls and the frames they carried, frames / calls is
+    // the average batch size
+    uint64_t rxBatchCalls;
+    uint64_t rxBatchFrames;
+    uint64_t txBatchCalls;
+    uint64_t txBatchFrames;
+    uint64_t budgetExhausted;    // stack ticks cut short by the loop budget
+    // frames of the legacy RX ring, processed in place or copied
+    uint64_t rxFramesZeroCopy;
+    uint64_t rxFramesCopied;
+    uint32_t rxMode;             // current NetworkStack_PicoTcp_RxMode_t
+} NetworkStack_PicoTcp_NicStatistics_t;
+
+typedef enum
+{
+    NetworkStack_PicoTcp_WAKE_CLIENT,   // socket RPC of a client
+    NetworkStack_PicoTcp_WAKE_NIC,      // frames left in the driver to poll
+    NetworkStack_PicoTcp_WAKE_TIMER,    // stack timer expired already
+    NetworkStack_PicoTcp_WAKE_EXTERNAL, // only a driver or Ticker event
+
+    NetworkStack_PicoTcp_WAKE_REASONS
+} NetworkStack_PicoTcp_WakeReason_t;
+
+typedef struct
+{
+    uint64_t wakeupsDelivered;   // loop wakeups signaled to the stack thread
+    uint64_t wakeupsSuppressed;  // not signaled as a wakeup was pending already
+    // loop iterations per wake reason, an iteration can have several reasons
+    uint64_t wakeReasons[NetworkStack_PicoTcp_WAKE_REASONS];
+    uint64_t notifyPassesSkipped; // iterations without new client events
+} NetworkStack_PicoTcp_LoopStatistics_t;
+
+typedef struct
+{
+    uint64_t reads;       // clock reads of picoTCP
+    uint64_t rpcsAvoided; // reads served from the snapshot of the stack tick
+} NetworkStack_PicoTcp_ClockStatistics_t;
+
+typedef struct
+{
+    int32_t  clientId;
+    uint64_t notifications;
+} NetworkStack_PicoTcp_ClientStatistics_t;
+
+typedef struct
+{
+    int32_t  handle;
+    int32_t  clientId;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+} NetworkStack_PicoTcp_SocketStatistics_t;
+
+/**
+ * Statistics written by getStatistics() to the start of the dataport. The
+ * counters are never reset and wrap around.
+ */
+typedef struct
+{
+    NetworkStack_PicoTcp_NicStatistics_t   nic;
+    NetworkStack_PicoTcp_LoopStatistics_t  loop;
+    NetworkStack_PicoTcp_ClockStatistics_t clock;
+
+    uint32_t numberOfClients;
+    NetworkStack_PicoTcp_ClientStatistics_t
+    clients[NetworkStack_PicoTcp_STATISTICS_MAX_CLIENTS];
+
+    // only sockets in use are reported
+    uint32_t numberOfSockets;
+    NetworkStack_PicoTcp_SocketStatistics_t
+    sockets[NetworkStack_PicoTcp_STATISTICS_MAX_SOCKETS];
+} NetworkStack_PicoTcp_Statistics_t;
+
+// Number of buckets of a histogram, bucket i counts the durations d with
+// 2^i <= d < 2^(i+1) timestamp ticks, bucket 0 also counts d = 0.
+#define NetworkStack_PicoTcp_HISTOGRAM_BUCKETS  32
+
+typedef struct
+{
+    uint32_t count[NetworkStack_PicoTcp_HISTOGRAM_BUCKETS];
+} NetworkStack_PicoTcp_Histogram_t;
+
+typedef enum
+{
+    NetworkStack_PicoTcp_PHASE_WAIT,     // waiting for the next loop event
+    NetworkStack_PicoTcp_PHASE_COMMANDS, // running queued socket RPCs
+    NetworkStack_PicoTcp_PHASE_TICK,     // picoTCP stack tick, incl. NIC poll
+    NetworkStack_PicoTcp_PHASE_NIC_POLL, // fetching frames from the driver
+    NetworkStack_PicoTcp_PHASE_NOTIFY,   // notifying clients about events
+
+    NetworkStack_PicoTcp_PHASES
+} NetworkStack_PicoTcp_Phase_t;
+
+typedef enum
+{
+    NetworkStack_PicoTcp_MUTEX_ALLOCATOR,
+    NetworkStack_PicoTcp_MUTEX_NWSTACK,
+    NetworkStack_PicoTcp_MUTEX_SOCKET_CB,
+    NetworkStack_PicoTcp_MUTEX_STACK_TS,
+
+    NetworkStack_PicoTcp_MUTEXES
+} NetworkStack_PicoTcp_Mutex_t;
+
+/**
+ * Profile written by getProfile() to the start of the dataport. Durations are
+ * in ticks of the stack's timestamp counter.
+ */
+typedef struct
+{
+    NetworkStack_PicoTcp_Histogram_t phases[NetworkStack_PicoTcp_PHASES];
+
+    struct
+    {
+        NetworkStack_PicoTcp_Histogram_t wait;
+        NetworkStack_PicoTcp_Histogram_t hold;
+    } mutexes[NetworkStack_PicoTcp_MUTEXES];
+} NetworkStack_PicoTcp_Profile_t;
+
+typedef enum
+{
+    NetworkStack_PicoTcp_RPC_CREATE,
+    NetworkStack_PicoTcp_RPC_CONNECT,
+    NetworkStack_PicoTcp_RPC_ACCEPT,
+    NetworkStack_PicoTcp_RPC_READ,
+    NetworkStack_PicoTcp_RPC_WRITE,
+    NetworkStack_PicoTcp_RPC_SENDTO,
+    NetworkStack_PicoTcp_RPC_RECVFROM,
+    NetworkStack_PicoTcp_RPC_GET_PENDING_EVENTS,
+    NetworkStack_PicoTcp_RPC_ACCEPT_MANY,
+
+    NetworkStack_PicoTcp_RPCS
+} NetworkStack_PicoTcp_Rpc_t;
+
+typedef struct
+{
+    NetworkStack_PicoTcp_Histogram_t duration;
+    // Part of the duration spent blocked on the stack: waiting for the thread
+    // safety mutex, or with NetworkStack_PicoTcp_USE_COMMAND_QUEUE, waiting
+    // for the stack thread to run the command.
+    NetworkStack_PicoTcp_Histogram_t stackTSWait;
+    uint64_t                         maxDuration;
+} NetworkStack_PicoTcp_RpcProfile_t;
+
+/**
+ * Profile of the socket RPCs of one client written by getClientProfile() to
+ * the start of the dataport. Durations are in ticks of the stack's timestamp
+ * counter.
+ */
+typedef struct
+{
+    int32_t                           clientId;
+    NetworkStack_PicoTcp_RpcProfile_t rpcs[NetworkStack_PicoTcp_RPCS];
+} NetworkStack_PicoTcp_ClientProfile_t;
+
 typedef struct
 {
     OS_Error_t (*configIpAddr)(
         const OS_NetworkStack_AddressConfig_t* config);
+    OS_Error_t (*getStatistics)(void);
+    OS_Error_t (*getTrace)(
+        size_t* len);
+    OS_Error_t (*getProfile)(void);
+    OS_Error_t (*getClientProfile)(
+        int clientIndex);
+
+    OS_Dataport_t dataport;
 }
 if_NetworkStack_PicoTcp_Config_t;
 
@@ -23,5 +208,10 @@ if_NetworkStack_PicoTcp_Config_t;
  */
 #define if_NetworkStack_PicoTcp_Config_ASSIGN(_prefix_)                        \
 {                                                                              \
-    .configIpAddr = _prefix_##_rpc_configIpAddr                                \
+    .configIpAddr     = _prefix_##_rpc_configIpAddr,                           \
+    .getStatistics    = _prefix_##_rpc_getStatistics,                          \
+    .getTrace         = _prefix_##_rpc_getTrace,                               \
+    .getProfile       = _prefix_##_rpc_getProfile,                             \
+    .getClientProfile = _prefix_##_rpc_getClientProfile,                       \
+    .dataport         = OS_DATAPORT_ASSIGN(_prefix_##_port)                    \
 }
@@ -0,0 +1,30 @@
+/*
+ * Network Stack batched NIC interface
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Maximum number of frames that can be passed with one call of rx_data_batch()
+// or tx_data_batch().
+#define NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES   32
+
+/**
+ * Layout of the dataports in batched mode. The descriptor table is at the
+ * start of the dataport, the frames can be placed anywhere behind it. Offsets
+ * are relative to the start of the dataport.
+ */
+typedef struct
+{
+    struct
+    {
+        uint32_t offset;
+        uint32_t len;
+    } desc[NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES];
+}
+NetworkStack_PicoTcp_NicBatch_t;
@@ -0,0 +1,43 @@
+/*
+ * Network Stack batched socket interface
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "OS_Error.h"
+#include "OS_Socket.h"
+
+#include <stdint.h>
+
+/**
+ * Record written by socket_acceptMany() to the client's socket dataport for
+ * each accepted connection. The records form an array at the start of the
+ * dataport.
+ */
+typedef struct
+{
+    int32_t          handle;
+    OS_Socket_Addr_t srcAddr;
+}
+NetworkStack_PicoTcp_AcceptRecord_t;
+
+typedef struct
+{
+    OS_Error_t (*socket_acceptMany)(
+        int  handle,
+        int  max,
+        int* accepted);
+}
+if_NetworkStack_PicoTcp_SocketBatch_t;
+
+/**
+ * Assigns the correct RPC function pointers to a struct supposed to hold them.
+ */
+#define if_NetworkStack_PicoTcp_SocketBatch_ASSIGN(_prefix_)                   \
+{                                                                              \
+    .socket_acceptMany = _prefix_##_batch_rpc_socket_acceptMany                \
+}
@@ -0,0 +1,44 @@
+/*
+ * Network Stack command queue
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Execution of socket RPCs on the stack thread. With the C flag
+ * NetworkStack_PicoTcp_USE_COMMAND_QUEUE, an RPC thread does not call picoTCP
+ * itself. It pushes a command to a lock-free queue, wakes up the main loop and
+ * blocks until the stack thread has run the command. The stack thread runs all
+ * pending commands as one batch in each loop iteration, before the stack tick.
+ *
+ * Without the flag, commands are run directly on the calling thread.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct NetworkStack_Command NetworkStack_Command_t;
+
+struct NetworkStack_Command
+{
+    void (*run)(NetworkStack_Command_t* command);
+
+    // set up by network_stack_command_execute()
+    NetworkStack_Command_t* next;
+    bool done;
+};
+
+// Runs the command on the stack thread and returns once it is done, the
+// command can live on the stack of the caller
+void
+network_stack_command_execute(
+    NetworkStack_Command_t* command);
+
+// Runs all pending commands, must only be called from the stack thread
+void
+network_stack_command_run_pending(void);
@@ -14,29 +14,92 @@
 
 #include "network/OS_NetworkStackTypes.h"
 
+#include "if_NetworkStack_PicoTcp_Config.h"
+
 #include <stddef.h>
+#include <stdint.h>
+
+// Number of sockets the stack manages. A host build can raise it, e.g. to
+// benchmark thousands of connections, see
+// NetworkStack_PicoTcp_DeclareHostLibrary().
+#if !defined(NetworkStack_PicoTcp_MAX_SOCKETS)
+#define NetworkStack_PicoTcp_MAX_SOCKETS    OS_NETWORK_MAXIMUM_SOCKET_NO
+#endif
+
+// Every statistics counter is written by one thread only, or only with a mutex
+// held, so it needs no atomic read-modify-write. The store must not tear
+// though, as the statistics RPC reads the counters from another thread.
+#define NetworkStack_STATS_ADD(_counter_, _n_)                                 \
+    __atomic_store_n(&(_counter_), (_counter_) + (_n_), __ATOMIC_RELAXED)
+
+#define NetworkStack_STATS_SET(_counter_, _value_)                             \
+    __atomic_store_n(&(_counter_), (_value_), __ATOMIC_RELAXED)
+
+#define NetworkStack_STATS_GET(_counter_)                                      \
+    __atomic_load_n(&(_counter_), __ATOMIC_RELAXED)
+
+// The event mask of a socket is set by the stack thread and cleared by the
+// stack thread and the RPC thread without a common lock, so every update is
+// an atomic read-modify-write. Setting and clearing return the previous mask.
+#define NetworkStack_EVENTS_SET(_socket_, _events_)                            \
+    __atomic_fetch_or(&(_socket_)->eventMask, (_events_), __ATOMIC_RELEASE)
+
+#define NetworkStack_EVENTS_CLEAR(_socket_, _events_)                          \
+    __atomic_fetch_and(&(_socket_)->eventMask, (uint16_t)~(_events_),          \
+                       __ATOMIC_ACQ_REL)
+
+#define NetworkStack_EVENTS_GET(_socket_)                                      \
+    __atomic_load_n(&(_socket_)->eventMask, __ATOMIC_ACQUIRE)
 
 typedef OS_Error_t (*nic_initialize_func_t)(
     const OS_NetworkStack_AddressConfig_t* config);
 typedef OS_Error_t (*stack_initialize_func_t)(void);
-typedef void (*stack_tick_func_t)(void);
+// Returns the time in ms until the next timer of the stack expires, or -1 if
+// this is unknown.
+typedef int64_t (*stack_tick_func_t)(void);
 
 typedef struct
 {
+    // Set by the RPC and the control thread, cleared by the control thread
+    // when it notifies the client. Only accessed with atomic builtins.
+    bool needsToBeNotified;
+
     // The following variables are written from one thread (control thread) and
     // read from another (RPC thread) therefore volatile is needed to tell the
     // compiler that variable content can change outside of its control.
-    volatile bool needsToBeNotified;
     volatile int currentSocketsInUse;
 
     int clientId;
     bool inUse;
     int socketQuota;
 
-    // Use head and tail per client to circulate through the pending events
-    // whenever _getPendingEvents() is called.
-    int head;
-    int tail;
+    // Notifications about new events are held back for notifyHoldoffUs, or
+    // until notifyEventThreshold events are pending if that is not 0. A
+    // holdoff of 0 notifies right away. The state below is only used by the
+    // control thread.
+    unsigned int notifyHoldoffUs;
+    unsigned int notifyEventThreshold;
+    unsigned int eventsSinceNotify;
+    bool isHoldoffRunning;
+    uint64_t holdoffStartMs;
+
+    // Intrusive FIFO of the client's sockets with pending events, linked
+    // through NetworkStack_SocketResources_t. Sockets that still have events
+    // after _getPendingEvents() go to the back again to circulate through
+    // them fairly. Protected by the socket control block mutex.
+    int readyHead;
+    int readyTail;
+    int readyCount;
+
+    // statistics, written by the control thread
+    uint64_t notifications;
+
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+    // Written by the if_OS_Socket and the SocketBatch RPC thread, also with
+    // NetworkStack_PicoTcp_USE_COMMAND_QUEUE, as an RPC is timed by the thread
+    // serving it.
+    NetworkStack_PicoTcp_RpcProfile_t rpcs[NetworkStack_PicoTcp_RPCS];
+#endif
 
     event_notify_func_t eventNotify;
 } NetworkStack_Client_t;
@@ -48,11 +111,13 @@ typedef struct
     // compiler that variable content can change outside of its control.
     volatile int status;
     volatile int parentHandle;
-    volatile uint16_t eventMask;
     volatile OS_Error_t current_error;
     volatile int pendingConnections;
     volatile int connected;
 
+    // only accessed with the NetworkStack_EVENTS_xxx macros
+    uint16_t eventMask;
+
     int clientId;
     int socketType;
 
@@ -60,6 +125,24 @@ typedef struct
     OS_Dataport_t buf;
 
     void* implementation_socket;
+
+    // Generation of this slot, it is part of the handle and changes whenever
+    // the slot gets freed. Protected by the socket control block mutex.
+    int generation;
+    int nextFree;
+
+    // Links in the ready list of the owning client, only valid if inReadyList
+    // is set. Protected by the socket control block mutex, inReadyList is
+    // stored atomically so clear_socket_events() can check it without it.
+    bool inReadyList;
+    int readyPrev;
+    int readyNext;
+
+    // Statistics, written by the thread running the socket operations, i.e.
+    // the if_OS_Socket RPC thread, or the stack thread with
+    // NetworkStack_PicoTcp_USE_COMMAND_QUEUE.
+    uint64_t bytesIn;
+    uint64_t bytesOut;
 } NetworkStack_SocketResources_t;
 
 typedef struct
@@ -70,6 +153,20 @@ typedef struct
     {
         event_notify_func_t notify_loop; // -> wait_event
 
+        // optional, arms a one-shot wakeup of the loop after the given time in
+        // ms, replacing any wakeup armed before
+        OS_Error_t (*schedule_loop)(uint64_t ms); // -> wait_event
+
+        // optional, returns a cheap monotonic timestamp in arbitrary ticks for
+        // profiling
+        uint64_t (*get_timestamp)(void);
+
+        // required with NetworkStack_PicoTcp_USE_COMMAND_QUEUE, blocks until
+        // *done is set, checking it again whenever notify_command is called
+        void (*wait_command)(const bool* done);
+        // wakes up all threads in wait_command
+        void (*notify_command)(void);
+
         NetworkStack_SocketResources_t* sockets;
 
         NetworkStack_Client_t* clients;
@@ -98,7 +195,12 @@ typedef struct
         struct
         {
             OS_Error_t (*dev_read)(size_t* len, size_t* frames_available);
+            // optional, NULL if the driver does not support batched reception
+            OS_Error_t (*dev_read_batch)(size_t max_frames, size_t* frames,
+                                         size_t* frames_available);
             OS_Error_t (*dev_write)(size_t* len);
+            // optional, NULL if the driver does not support batched sending
+            OS_Error_t (*dev_write_batch)(size_t frames);
             OS_Error_t (*get_mac)(void);
             // API extension: OS_Error_t (*get_link_state)(void);
         } rpc;
@@ -122,6 +224,17 @@ typedef struct
 
     int number_of_sockets;
     int number_of_clients;
+
+    // first slot of the free socket list, -1 if all sockets are in use
+    int free_sockets_head;
+
+    // Set whenever a client may need a notification, the notification pass is
+    // skipped in loop iterations without it.
+    bool isNotifyPassNeeded;
+
+    // statistics, written by the control thread
+    uint64_t wakeReasons[NetworkStack_PicoTcp_WAKE_REASONS];
+    uint64_t notifyPassesSkipped;
 } NetworkStack_t;
 
 const NetworkStack_CamkesConfig_t* config_get_handlers(void);
@@ -132,7 +245,22 @@ const NetworkStack_CamkesConfig_t* config_get_handlers(void);
 
 void wait_network_event(void);
 
-void internal_notify_main_loop(void);
+void internal_notify_main_loop(NetworkStack_PicoTcp_WakeReason_t reason);
+
+// Returns the NetworkStack_PicoTcp_WakeReason_t bits signaled since the last
+// call, 0 if the loop was woken up by an external event only.
+uint32_t internal_take_main_loop_wake_reasons(void);
+
+void internal_get_loop_statistics(
+    NetworkStack_PicoTcp_LoopStatistics_t* stats);
+
+void internal_schedule_main_loop(uint64_t ms);
+
+uint64_t internal_get_timestamp(void);
+
+void internal_wait_command_done(const bool* done);
+
+void internal_notify_command_done(void);
 
 const OS_Dataport_t* get_nic_port_from(void);
 const OS_Dataport_t* get_nic_port_to(void);
@@ -142,10 +270,20 @@ nic_dev_read(
     size_t* pLen,
     size_t* frameRemaining);
 
+OS_Error_t
+nic_dev_read_batch(
+    size_t  maxFrames,
+    size_t* pFrames,
+    size_t* frameRemaining);
+
 OS_Error_t
 nic_dev_write(
     size_t* pLen);
 
+OS_Error_t
+nic_dev_write_batch(
+    size_t frames);
+
 OS_Error_t
 nic_dev_get_mac_address(void);
 
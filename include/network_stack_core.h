@@ -15,6 +15,7 @@
 
 #include "lib_debug/Debug.h"
 
+#include "if_NetworkStack_PicoTcp_Config.h"
 #include "network_stack_config.h"
 
 #include <stdint.h>
@@ -120,6 +121,19 @@ free_handle(
     const int handle,
     const int clientId);
 
+void
+mark_socket_ready(
+    const int handle);
+
+void
+clear_socket_events(
+    NetworkStack_SocketResources_t* const socket,
+    const uint16_t                         events);
+
+void
+request_client_notification(
+    NetworkStack_Client_t* const client);
+
 void
 set_parent_handle(
     const int handle,
@@ -138,6 +152,38 @@ get_client_id_buf(void);
 int
 get_client_id_buf_size(void);
 
+void
+clock_snapshot_take(void);
+
+void
+clock_snapshot_release(void);
+
+// Returns the time of the last clock read in ms without reading the clock, so
+// it is cheap and can be called from any thread.
+uint64_t
+clock_snapshot_get(void);
+
+void
+clock_get_statistics(
+    NetworkStack_PicoTcp_ClockStatistics_t* stats);
+
+// implementation of the if_NetworkStack_PicoTcp_SocketBatch RPC, it uses the
+// client of the current if_OS_Socket RPC
+OS_Error_t
+networkStack_rpc_socket_acceptMany(
+    const int  handle,
+    const int  max,
+    int* const pAccepted);
+
+OS_Error_t
+NetworkStack_getStatistics(
+    NetworkStack_PicoTcp_Statistics_t* const stats);
+
+OS_Error_t
+NetworkStack_getClientProfile(
+    const int                                   clientIndex,
+    NetworkStack_PicoTcp_ClientProfile_t* const profile);
+
 OS_Error_t
 NetworkStack_init(
     const NetworkStack_CamkesConfig_t* const camkes_config,
@@ -0,0 +1,184 @@
+/*
+ * Network Stack host (Linux) environment
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Runs the network stack core in a plain Linux process, without CAmkES. The
+ * CAmkES parts are replaced by threads, mutexes and condition variables, the
+ * NIC driver by an in-process wire that hands the frames sent by the stack to
+ * a callback and accepts frames to be received. The wire offers the driver
+ * interfaces of the target, see NetworkStack_Host_NicMode_t.
+ *
+ * Client calls use the NetworkStack_Host_socket_xxx() functions, after the
+ * calling thread has selected the client it acts as. Like the RPC threads of
+ * the component, they run the calls of one interface one after the other.
+ */
+
+#pragma once
+
+#include "OS_Error.h"
+#include "OS_Socket.h"
+#include "OS_Types.h"
+
+#include "network/OS_NetworkStackTypes.h"
+
+#include "if_NetworkStack_PicoTcp_SocketBatch.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of clients supported by the host environment
+#define NetworkStack_Host_MAX_CLIENTS   8
+
+/**
+ * Driver interface the NIC stand-in offers to the stack.
+ */
+typedef enum
+{
+    NetworkStack_Host_NIC_EVENT, // rx_data(), one frame per call
+    NetworkStack_Host_NIC_BATCH, // rx_data_batch() and tx_data_batch()
+    NetworkStack_Host_NIC_RING,  // legacy RX ring in the dataport
+} NetworkStack_Host_NicMode_t;
+
+/**
+ * Called for every frame the stack sends. The frame buffer is only valid
+ * during the call, it is called from the stack's control thread. It may pass
+ * frames back with NetworkStack_Host_receiveFrame(), like a wire with a peer
+ * on the other end.
+ */
+typedef void (*NetworkStack_Host_TxFunc_t)(
+    void*       ctx,
+    const void* frame,
+    size_t      len);
+
+typedef struct
+{
+    int    number_of_clients;
+    int    socket_quota;       // per client
+    // per client, see NetworkStack_ClientConfig of the CAmkES component
+    unsigned int notify_holdoff_us;
+    unsigned int notify_event_threshold;
+    size_t client_buf_size;    // size of each client's dataport
+    uint8_t mac[6];
+    NetworkStack_Host_NicMode_t nic_mode;
+
+    NetworkStack_Host_TxFunc_t tx;
+    void*                      tx_ctx;
+} NetworkStack_Host_Config_t;
+
+/**
+ * Initializes the network stack and starts its control thread.
+ */
+OS_Error_t
+NetworkStack_Host_start(
+    const NetworkStack_Host_Config_t*      hostConfig,
+    const OS_NetworkStack_AddressConfig_t* config);
+
+/**
+ * Selects the client the calling thread acts as for the following
+ * networkStack_rpc_socket_xxx() calls.
+ */
+void
+NetworkStack_Host_setClient(
+    int clientIndex);
+
+/**
+ * Returns the dataport of a client.
+ */
+void*
+NetworkStack_Host_getClientBuf(
+    int clientIndex);
+
+/**
+ * Blocks until the stack notified the client about pending events.
+ */
+void
+NetworkStack_Host_waitClientEvent(
+    int clientIndex);
+
+/**
+ * Queues a frame to be received by the stack, copying it.
+ *
+ * @retval OS_SUCCESS               Operation was successful.
+ * @retval OS_ERROR_TRY_AGAIN       The receive queue is full.
+ * @retval OS_ERROR_BUFFER_TOO_SMALL The frame is too big.
+ */
+OS_Error_t
+NetworkStack_Host_receiveFrame(
+    const void* frame,
+    size_t      len);
+
+//------------------------------------------------------------------------------
+// Socket API of the stack, on the target these are the RPCs of if_OS_Socket
+//------------------------------------------------------------------------------
+
+OS_Error_t
+NetworkStack_Host_socket_create(
+    const int  domain,
+    const int  socket_type,
+    int* const pHandle);
+
+OS_Error_t
+NetworkStack_Host_socket_close(
+    const int handle);
+
+OS_Error_t
+NetworkStack_Host_socket_connect(
+    const int                     handle,
+    const OS_Socket_Addr_t* const dstAddr);
+
+OS_Error_t
+NetworkStack_Host_socket_bind(
+    const int                     handle,
+    const OS_Socket_Addr_t* const localAddr);
+
+OS_Error_t
+NetworkStack_Host_socket_listen(
+    const int handle,
+    const int backlog);
+
+OS_Error_t
+NetworkStack_Host_socket_accept(
+    const int               handle,
+    int* const              pClient_handle,
+    OS_Socket_Addr_t* const srcAddr);
+
+// RPC of if_NetworkStack_PicoTcp_SocketBatch
+OS_Error_t
+NetworkStack_Host_socket_acceptMany(
+    const int  handle,
+    const int  max,
+    int* const pAccepted);
+
+OS_Error_t
+NetworkStack_Host_socket_write(
+    const int     handle,
+    size_t* const pLen);
+
+OS_Error_t
+NetworkStack_Host_socket_read(
+    const int     handle,
+    size_t* const pLen);
+
+OS_Error_t
+NetworkStack_Host_socket_sendto(
+    const int                     handle,
+    size_t* const                 pLen,
+    const OS_Socket_Addr_t* const dstAddr);
+
+OS_Error_t
+NetworkStack_Host_socket_recvfrom(
+    const int               handle,
+    size_t* const           pLen,
+    OS_Socket_Addr_t* const srcAddr);
+
+OS_Error_t
+NetworkStack_Host_socket_getPendingEvents(
+    const size_t  maxRequestedSize,
+    size_t* const pNumberOfEvents);
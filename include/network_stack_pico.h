@@ -11,6 +11,7 @@
 #include "OS_Socket.h"
 #include "network/OS_SocketTypes.h"
 
+#include "if_NetworkStack_PicoTcp_SocketBatch.h"
 #include "network_stack_core.h"
 
 #include <stdint.h>
@@ -54,6 +55,13 @@ network_stack_pico_socket_accept(
     int* const pClient_handle,
     OS_Socket_Addr_t* const srcAddr);
 
+OS_Error_t
+network_stack_pico_socket_acceptMany(
+    const int handle,
+    const int max,
+    NetworkStack_PicoTcp_AcceptRecord_t* const records,
+    int* const pAccepted);
+
 OS_Error_t
 network_stack_pico_socket_write(
     const int handle,
@@ -11,6 +11,69 @@
 #include "OS_Error.h"
 #include "OS_Types.h"
 
+#include "if_NetworkStack_PicoTcp_Config.h"
+
+#include <stdbool.h>
+
+// Adaptive busy polling of the NIC, compiled in with the C flag
+// NetworkStack_PicoTcp_USE_BUSY_POLL. After this many consecutive polls with
+// load, i.e. with at least BUSY_POLL_ENTER_FRAMES frames or an exhausted loop
+// score, the loop polls the driver without waiting for its notification. It
+// returns to event driven wakeups once no frame arrived for
+// BUSY_POLL_WINDOW_MS.
+#if !defined(NetworkStack_PicoTcp_BUSY_POLL_ENTER_POLLS)
+#define NetworkStack_PicoTcp_BUSY_POLL_ENTER_POLLS  4
+#endif
+
+#if !defined(NetworkStack_PicoTcp_BUSY_POLL_ENTER_FRAMES)
+#define NetworkStack_PicoTcp_BUSY_POLL_ENTER_FRAMES 8
+#endif
+
+#if !defined(NetworkStack_PicoTcp_BUSY_POLL_WINDOW_MS)
+#define NetworkStack_PicoTcp_BUSY_POLL_WINDOW_MS    2
+#endif
+
+// Work budget of one stack tick, to bound the time the stack holds the thread
+// safety mutex during bursts. Once the NIC has received and sent this many
+// frames, or this many us have passed since the tick started, further frames
+// stay in the driver or in picoTCP's queue. The loop then notifies the clients
+// and runs again right away. 0 means no limit. The time budget needs a CPU
+// counter for the timestamps and takes effect after calibrating it against the
+// clock for about LOOP_BUDGET_CALIBRATION_MS.
+#if !defined(NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES)
+#define NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES         0
+#endif
+
+#if !defined(NetworkStack_PicoTcp_LOOP_BUDGET_US)
+#define NetworkStack_PicoTcp_LOOP_BUDGET_US             0
+#endif
+
+#if !defined(NetworkStack_PicoTcp_LOOP_BUDGET_CALIBRATION_MS)
+#define NetworkStack_PicoTcp_LOOP_BUDGET_CALIBRATION_MS 1000
+#endif
+
 OS_Error_t
 pico_nic_initialize(
     const OS_NetworkStack_AddressConfig_t* config);
+
+// Starts the work budget of a stack tick, the clock snapshot must be taken
+void
+pico_nic_budget_start(void);
+
+void
+pico_nic_flush(void);
+
+// While set, the NIC is not polled for RX and the busy poll and work budget
+// state stay as they are, so a stack tick only sends. Caller must hold the
+// thread safety mutex.
+void
+pico_nic_set_tx_only(
+    bool isTxOnly);
+
+// Returns true while the main loop shall poll the NIC without waiting
+bool
+pico_nic_is_busy_polling(void);
+
+void
+pico_nic_get_statistics(
+    NetworkStack_PicoTcp_NicStatistics_t* stats);
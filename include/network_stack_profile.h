@@ -0,0 +1,140 @@
+/*
+ * Network Stack profiling
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Log2 histograms of the durations of the main loop phases, of the wait
+ * and hold times of the component mutexes and of the socket RPCs of each
+ * client. Profiling is compiled in with the
+ * C flag NetworkStack_PicoTcp_USE_PROFILING, otherwise the macros below do
+ * nothing.
+ *
+ * Durations are measured with the optional get_timestamp() callback of the
+ * CAmkES configuration, without it all durations are 0.
+ */
+
+#pragma once
+
+#include "if_NetworkStack_PicoTcp_Config.h"
+
+#include <stdint.h>
+
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+
+#define NetworkStack_PROFILE_START(_start_)                                    \
+    const uint64_t _start_ = internal_get_timestamp()
+
+#define NetworkStack_PROFILE_PHASE(_phase_, _start_)                           \
+    network_stack_profile_phase(_phase_, _start_)
+
+#define NetworkStack_PROFILE_MUTEX_LOCKED(_mutex_, _start_)                    \
+    network_stack_profile_mutex_locked(_mutex_, _start_)
+
+#define NetworkStack_PROFILE_MUTEX_UNLOCK(_mutex_)                             \
+    network_stack_profile_mutex_unlock(_mutex_)
+
+#define NetworkStack_PROFILE_COMMAND_DONE(_start_)                             \
+    network_stack_profile_command_done(_start_)
+
+// Times the rest of the enclosing function, the duration is recorded for the
+// calling client when the function returns, whatever return is taken.
+#define NetworkStack_PROFILE_RPC(_rpc_)                                        \
+    __attribute__((cleanup(network_stack_profile_rpc_end)))                    \
+    NetworkStack_RpcTiming_t _rpcTiming_ = network_stack_profile_rpc_begin(_rpc_)
+
+#else
+
+#define NetworkStack_PROFILE_START(_start_)                 do {} while (0)
+#define NetworkStack_PROFILE_PHASE(_phase_, _start_)        do {} while (0)
+#define NetworkStack_PROFILE_MUTEX_LOCKED(_mutex_, _start_) do {} while (0)
+#define NetworkStack_PROFILE_MUTEX_UNLOCK(_mutex_)          do {} while (0)
+#define NetworkStack_PROFILE_COMMAND_DONE(_start_)          do {} while (0)
+#define NetworkStack_PROFILE_RPC(_rpc_)                     do {} while (0)
+
+#endif
+
+// Defines _name_##_profiled_lock() and _name_##_profiled_unlock(), which call
+// _name_##_lock() and _name_##_unlock() and record the wait and hold times of
+// _mutex_. They are meant for the mutexes the CAmkES configuration hands out
+// directly, e.g. the allocator and the picoTCP mutex, the others are profiled
+// by their internal_xxx() functions.
+#define NetworkStack_PROFILE_MUTEX_DEFINE(_name_, _mutex_)                     \
+    static int                                                                 \
+    _name_##_profiled_lock(void)                                               \
+    {                                                                          \
+        NetworkStack_PROFILE_START(start);                                     \
+        const int ret = _name_##_lock();                                       \
+        NetworkStack_PROFILE_MUTEX_LOCKED(_mutex_, start);                     \
+        return ret;                                                            \
+    }                                                                          \
+                                                                               \
+    static int                                                                 \
+    _name_##_profiled_unlock(void)                                             \
+    {                                                                          \
+        NetworkStack_PROFILE_MUTEX_UNLOCK(_mutex_);                            \
+        return _name_##_unlock();                                              \
+    }
+
+typedef struct
+{
+    NetworkStack_PicoTcp_Rpc_t rpc;
+    uint64_t                   start;
+    uint64_t                   stackTSWaited;
+} NetworkStack_RpcTiming_t;
+
+void
+network_stack_histogram_add(
+    NetworkStack_PicoTcp_Histogram_t* histogram,
+    uint64_t                          duration);
+
+void
+network_stack_histogram_get(
+    NetworkStack_PicoTcp_Histogram_t*       dst,
+    const NetworkStack_PicoTcp_Histogram_t* src);
+
+// Records the duration of a loop phase that started at start
+void
+network_stack_profile_phase(
+    NetworkStack_PicoTcp_Phase_t phase,
+    uint64_t                     start);
+
+// Records the time waited for a mutex since start, must be called with the
+// mutex held
+void
+network_stack_profile_mutex_locked(
+    NetworkStack_PicoTcp_Mutex_t mutex,
+    uint64_t                     start);
+
+// Records the time since start as waited for the stack, for a command that was
+// queued at start and is done now
+void
+network_stack_profile_command_done(
+    uint64_t start);
+
+// Records the time the mutex was held, must be called before unlocking it
+void
+network_stack_profile_mutex_unlock(
+    NetworkStack_PicoTcp_Mutex_t mutex);
+
+void
+network_stack_profile_get(
+    NetworkStack_PicoTcp_Profile_t* profile);
+
+NetworkStack_RpcTiming_t
+network_stack_profile_rpc_begin(
+    NetworkStack_PicoTcp_Rpc_t rpc);
+
+void
+network_stack_profile_rpc_end(
+    const NetworkStack_RpcTiming_t* timing);
+
+void
+network_stack_profile_rpc_get(
+    NetworkStack_PicoTcp_RpcProfile_t*       dst,
+    const NetworkStack_PicoTcp_RpcProfile_t* src);
@@ -0,0 +1,71 @@
+/*
+ * Network Stack trace ring
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/**
+ * @file
+ *
+ * Binary trace of socket level events for the hot paths, where formatting a
+ * log message costs too much. Records have a fixed size and go to a ring that
+ * overwrites the oldest records. They are only formatted as text when the
+ * ring is drained through the getTrace() RPC.
+ *
+ * Tracing is compiled in with the C flag NetworkStack_PicoTcp_USE_TRACE,
+ * otherwise NetworkStack_TRACE() does nothing.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of records in the ring, must be a power of two
+#if !defined(NetworkStack_PicoTcp_TRACE_RING_SIZE)
+#define NetworkStack_PicoTcp_TRACE_RING_SIZE    1024
+#endif
+
+typedef enum
+{
+    NetworkStack_TRACE_SOCKET_OPENED = 1,  // arg0: socket type
+    NetworkStack_TRACE_SOCKET_CLOSED,
+    NetworkStack_TRACE_CONN_REQUEST,       // on the listening socket
+    NetworkStack_TRACE_CONN_ESTABLISHED,   // arg0: remote IPv4 address
+    NetworkStack_TRACE_CONN_ACCEPTED,      // arg0: remote IPv4 address,
+                                           // arg1: remote port
+    NetworkStack_TRACE_CONN_CLOSED,        // arg0: remote IPv4 address
+} NetworkStack_TraceEvent_t;
+
+#if defined(NetworkStack_PicoTcp_USE_TRACE)
+#define NetworkStack_TRACE(_event_, _handle_, _arg0_, _arg1_)                  \
+    network_stack_trace(_event_, _handle_, _arg0_, _arg1_)
+#else
+#define NetworkStack_TRACE(_event_, _handle_, _arg0_, _arg1_)                  \
+    do {} while (0)
+#endif
+
+/**
+ * Adds a record to the ring, can be called from any thread. IPv4 addresses
+ * are passed in network byte order, as picoTCP stores them.
+ */
+void
+network_stack_trace(
+    NetworkStack_TraceEvent_t event,
+    int                       handle,
+    uint32_t                  arg0,
+    uint32_t                  arg1);
+
+/**
+ * Formats the records added since the last call as text lines into buf, as
+ * many as fit. Records that were overwritten before they could be drained are
+ * reported as lost. Must not be called from several threads in parallel.
+ *
+ * @return the number of characters written, without a terminating NUL
+ */
+size_t
+network_stack_trace_drain(
+    char*  buf,
+    size_t size);
@@ -16,6 +16,8 @@
 
 #include "network_stack_core.h"
 #include "network_stack_pico.h"
+#include "network_stack_profile.h"
+#include "network_stack_trace.h"
 
 #include <arpa/inet.h>
 #include <string.h>
@@ -32,6 +34,16 @@
 // above mentioned macro.
 #define MIN_BADGE_ID 101
 
+// Timer ID used for the one-shot wakeups of the main loop. The Ticker component
+// maps it to a timer of its own. A tickless stack schedules all its wakeups,
+// so the Ticker stops its periodic tick, otherwise the wakeups are in between
+// the periodic ticks.
+#if defined(NetworkStack_PicoTcp_USE_TICKLESS)
+#define LOOP_WAKEUP_TIMER_ID 0
+#else
+#define LOOP_WAKEUP_TIMER_ID 1
+#endif
+
 #ifdef USE_LOGSERVER
 static OS_LoggerFilter_Handle_t filter;
 #endif
@@ -46,11 +58,31 @@ static const OS_NetworkStack_AddressConfig_t* pIpAddrConfig = NULL;
 
 volatile static OS_NetworkStack_State_t currentState = UNINITIALIZED;
 
+// While a snapshot is taken, Timer_getTimeMs() returns the snapshot time instead
+// of asking the TimeServer. Snapshots are taken by a stack tick with the thread
+// safety mutex held, on the control thread or, with
+// NetworkStack_PicoTcp_USE_INLINE_TX, on an RPC thread for its inline TX tick.
+// picoTCP reads the clock with the mutex held only, so no other thread can
+// read it meanwhile. The statistics are read with NetworkStack_STATS_GET() by
+// getStatistics().
+static struct
+{
+    bool     isSnapshot;
+    uint64_t ms; // last time read, never decreases
+    uint64_t reads;
+    uint64_t rpcsAvoided;
+} timeCache;
+
 // TODO: Until all the relevant connector functions are declared in the CAmkES
 // header, we need to declare the following function here in order to use it.
 seL4_Word
 networkStack_rpc_get_sender_id(void);
 
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+seL4_Word
+networkStack_batch_rpc_get_sender_id(void);
+#endif
+
 // TODO: With the current implementation these function definitions are exported
 // to the library so it can make use of them. Therefore they cannot be set to
 // static. This should reworked into a nicer solution that allows for a cleaner
@@ -80,22 +112,41 @@ networkStack_setState(OS_NetworkStack_State_t state)
     }
 }
 
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+// Badge of the if_NetworkStack_PicoTcp_SocketBatch RPC the calling thread is
+// running, 0 outside of it. It is the same as the badge of the client's
+// if_OS_Socket connection.
+static __thread seL4_Word socketBatchSenderId = 0;
+#endif
+
+static seL4_Word
+get_sender_id(void)
+{
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+    if (0 != socketBatchSenderId)
+    {
+        return socketBatchSenderId;
+    }
+#endif
+    return networkStack_rpc_get_sender_id();
+}
+
 int
 get_client_id(void)
 {
-    return networkStack_rpc_get_sender_id();
+    return get_sender_id();
 }
 
 uint8_t*
 get_client_id_buf(void)
 {
-    return networkStack_rpc_buf(networkStack_rpc_get_sender_id());
+    return networkStack_rpc_buf(get_sender_id());
 }
 
 int
 get_client_id_buf_size(void)
 {
-    return networkStack_rpc_buf_size(networkStack_rpc_get_sender_id());
+    return networkStack_rpc_buf_size(get_sender_id());
 }
 
 bool isValidIp4Address(const char* ipAddress)
@@ -113,16 +164,130 @@ Timer_getTimeMs(void)
     OS_Error_t err;
     uint64_t   ms;
 
+    NetworkStack_STATS_ADD(timeCache.reads, 1);
+
+    if (timeCache.isSnapshot)
+    {
+        NetworkStack_STATS_ADD(timeCache.rpcsAvoided, 1);
+        return timeCache.ms;
+    }
+
     if ((err = TimeServer_getTime(&timer, TimeServer_PRECISION_MSEC, &ms)) !=
         OS_SUCCESS)
     {
+        // keep the last time, so the clock does not jump backwards
         Debug_LOG_ERROR("TimeServer_getTime() failed with %d", err);
-        ms = 0;
+        return timeCache.ms;
+    }
+
+    if (ms > timeCache.ms)
+    {
+        __atomic_store_n(&timeCache.ms, ms, __ATOMIC_RELAXED);
+    }
+
+    return timeCache.ms;
+}
+
+//------------------------------------------------------------------------------
+void
+clock_snapshot_take(void)
+{
+    timeCache.isSnapshot = false;
+    Timer_getTimeMs();
+    timeCache.isSnapshot = true;
+}
+
+//------------------------------------------------------------------------------
+void
+clock_snapshot_release(void)
+{
+    timeCache.isSnapshot = false;
+}
+
+//------------------------------------------------------------------------------
+uint64_t
+clock_snapshot_get(void)
+{
+    return __atomic_load_n(&timeCache.ms, __ATOMIC_RELAXED);
+}
+
+//------------------------------------------------------------------------------
+void
+clock_get_statistics(
+    NetworkStack_PicoTcp_ClockStatistics_t* stats)
+{
+    stats->reads       = NetworkStack_STATS_GET(timeCache.reads);
+    stats->rpcsAvoided = NetworkStack_STATS_GET(timeCache.rpcsAvoided);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+schedule_loop_wakeup(
+    uint64_t ms)
+{
+    return internal_timeServer_rpc_oneshot_relative(LOOP_WAKEUP_TIMER_ID,
+                                                    ms * NS_IN_MS);
+}
+
+//------------------------------------------------------------------------------
+// Each socket RPC interface has its own thread, which waits on its own
+// semaphore. A thread may find a post for a command that was already done when
+// it checked, so check again after each wakeup.
+static void
+wait_command_done(
+    const bool* done)
+{
+    while (!__atomic_load_n(done, __ATOMIC_ACQUIRE))
+    {
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+        if (0 != socketBatchSenderId)
+        {
+            commandDoneBatch_wait();
+            continue;
+        }
+#endif
+        commandDone_wait();
     }
+}
 
-    return ms;
+//------------------------------------------------------------------------------
+// The batch may have held commands of both RPC threads, so wake up both. A post
+// nobody waits for only costs the next wait one more check.
+static void
+notify_command_done(void)
+{
+    commandDone_post();
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+    commandDoneBatch_post();
+#endif
 }
 
+//------------------------------------------------------------------------------
+// Timestamp for profiling, read from the CPU's counter without a system call.
+// On architectures without a counter readable in user mode all durations are
+// 0.
+static uint64_t
+get_timestamp(void)
+{
+#if defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// The allocator and picoTCP mutexes are handed to the configuration directly,
+// so they are profiled here.
+NetworkStack_PROFILE_MUTEX_DEFINE(allocatorMutex,
+                                  NetworkStack_PicoTcp_MUTEX_ALLOCATOR)
+NetworkStack_PROFILE_MUTEX_DEFINE(nwstackMutex,
+                                  NetworkStack_PicoTcp_MUTEX_NWSTACK)
+
 //------------------------------------------------------------------------------
 void
 pre_init(void)
@@ -169,6 +334,87 @@ if_config_rpc_configIpAddr(
 #endif
 }
 
+#if defined(NetworkStack_PicoTcp_USE_SOCKET_BATCH)
+OS_Error_t
+networkStack_batch_rpc_socket_acceptMany(
+    int  handle,
+    int  max,
+    int* accepted)
+{
+    socketBatchSenderId = networkStack_batch_rpc_get_sender_id();
+    OS_Error_t err = networkStack_rpc_socket_acceptMany(handle, max, accepted);
+    socketBatchSenderId = 0;
+
+    return err;
+}
+#endif
+
+OS_Error_t
+if_config_rpc_getStatistics(void)
+{
+    static const OS_Dataport_t port = OS_DATAPORT_ASSIGN(if_config_port);
+
+    if (OS_Dataport_getSize(port) < sizeof(NetworkStack_PicoTcp_Statistics_t))
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    return NetworkStack_getStatistics(OS_Dataport_getBuf(port));
+}
+
+OS_Error_t
+if_config_rpc_getTrace(
+    size_t* pLen)
+{
+#if defined(NetworkStack_PicoTcp_USE_TRACE)
+    static const OS_Dataport_t port = OS_DATAPORT_ASSIGN(if_config_port);
+
+    *pLen = network_stack_trace_drain(OS_Dataport_getBuf(port),
+                                      OS_Dataport_getSize(port));
+    return OS_SUCCESS;
+#else
+    *pLen = 0;
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+OS_Error_t
+if_config_rpc_getProfile(void)
+{
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+    static const OS_Dataport_t port = OS_DATAPORT_ASSIGN(if_config_port);
+
+    if (OS_Dataport_getSize(port) < sizeof(NetworkStack_PicoTcp_Profile_t))
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    network_stack_profile_get(OS_Dataport_getBuf(port));
+    return OS_SUCCESS;
+#else
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+OS_Error_t
+if_config_rpc_getClientProfile(
+    int clientIndex)
+{
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+    static const OS_Dataport_t port = OS_DATAPORT_ASSIGN(if_config_port);
+
+    if (OS_Dataport_getSize(port)
+        < sizeof(NetworkStack_PicoTcp_ClientProfile_t))
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    return NetworkStack_getClientProfile(clientIndex, OS_Dataport_getBuf(port));
+#else
+    return OS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
 OS_Error_t
 initializeNetworkStack(void)
 {
@@ -198,7 +444,8 @@ initializeNetworkStack(void)
         return OS_ERROR_OUT_OF_BOUNDS;;
     }
 
-    static NetworkStack_SocketResources_t sockets[OS_NETWORK_MAXIMUM_SOCKET_NO];
+    static NetworkStack_SocketResources_t
+    sockets[NetworkStack_PicoTcp_MAX_SOCKETS];
 
     static const event_notify_func_t notifications[MAX_CLIENTS_NUM] =
     {
@@ -240,9 +487,14 @@ initializeNetworkStack(void)
         clients[i].inUse = true;
         clients[i].clientId = MIN_BADGE_ID + i;
         clients[i].socketQuota = networkStack_config.clients[i].socket_quota;
+        clients[i].notifyHoldoffUs =
+            networkStack_config.clients[i].notify_holdoff_us;
+        clients[i].notifyEventThreshold =
+            networkStack_config.clients[i].notify_event_threshold;
         clients[i].currentSocketsInUse = 0;
-        clients[i].tail = 0;
-        clients[i].head = 0;
+        clients[i].readyHead = -1;
+        clients[i].readyTail = -1;
+        clients[i].readyCount = 0;
         clients[i].eventNotify = notifications[i];
     }
 
@@ -253,12 +505,16 @@ initializeNetworkStack(void)
         .internal =
         {
             .notify_loop        = event_internal_emit,
+            .schedule_loop      = schedule_loop_wakeup,
+            .get_timestamp      = get_timestamp,
+            .wait_command       = wait_command_done,
+            .notify_command     = notify_command_done,
 
-            .allocator_lock     = allocatorMutex_lock,
-            .allocator_unlock   = allocatorMutex_unlock,
+            .allocator_lock     = allocatorMutex_profiled_lock,
+            .allocator_unlock   = allocatorMutex_profiled_unlock,
 
-            .nwStack_lock       = nwstackMutex_lock,
-            .nwStack_unlock     = nwstackMutex_unlock,
+            .nwStack_lock       = nwstackMutex_profiled_lock,
+            .nwStack_unlock     = nwstackMutex_profiled_unlock,
 
             .socketCB_lock      = socketControlBlockMutex_lock,
             .socketCB_unlock    = socketControlBlockMutex_unlock,
@@ -267,7 +523,7 @@ initializeNetworkStack(void)
             .stackTS_unlock     = stackThreadSafeMutex_unlock,
 
             .number_of_clients  = MAX_CLIENTS_NUM,
-            .number_of_sockets  = OS_NETWORK_MAXIMUM_SOCKET_NO,
+            .number_of_sockets  = NetworkStack_PicoTcp_MAX_SOCKETS,
 
             .sockets            = sockets,
             .clients            = clients
@@ -281,6 +537,10 @@ initializeNetworkStack(void)
             .rpc =
             {
                 .dev_read       = nic_rpc_rx_data,
+#if defined(NetworkStack_PicoTcp_USE_NIC_BATCH)
+                .dev_read_batch = nic_batch_rpc_rx_data_batch,
+                .dev_write_batch = nic_batch_rpc_tx_data_batch,
+#endif
                 .dev_write      = nic_rpc_tx_data,
                 .get_mac        = nic_rpc_get_mac_address,
             }
@@ -10,6 +10,43 @@
 #include "OS_Error.h"
 #include <camkes.h>
 
+#include <stdbool.h>
+
+// Timer IDs used with the TimeServer
+#define TICKER_TIMER_ID_PERIODIC    0
+#define TICKER_TIMER_ID_ONESHOT     1
+
+// The network stack can use exactly one one-shot timer through the proxy. With
+// the first ID it replaces the periodic tick, with the second one it wakes up
+// the stack in between the periodic ticks.
+#define PROXY_TIMER_ID_ONESHOT      0
+#define PROXY_TIMER_ID_WAKEUP       1
+
+// The periodic tick is only needed as long as the network stack does not
+// schedule its wakeups itself.
+static volatile bool isPeriodicTickRunning = false;
+
+
+//------------------------------------------------------------------------------
+static void
+stop_periodic_tick(void)
+{
+    if (!isPeriodicTickRunning)
+    {
+        return;
+    }
+
+    OS_Error_t err = timeServer_rpc_stop(TICKER_TIMER_ID_PERIODIC);
+    if (OS_SUCCESS != err)
+    {
+        Debug_LOG_ERROR("timeServer_rpc_stop() failed, code %d", err);
+        return;
+    }
+
+    isPeriodicTickRunning = false;
+    Debug_LOG_INFO("Network stack schedules its wakeups, periodic tick stopped");
+}
+
 
 //------------------------------------------------------------------------------
 int run(void)
@@ -17,17 +54,19 @@ int run(void)
     Debug_LOG_INFO("Ticker running");
 
     // set up a tick every second
-    int ret = timeServer_rpc_periodic(0, NS_IN_S);
+    int ret = timeServer_rpc_periodic(TICKER_TIMER_ID_PERIODIC, NS_IN_S);
     if (0 != ret)
     {
         Debug_LOG_ERROR("timeServer_rpc_periodic() failed, code %d", ret);
         return -1;
     }
+    isPeriodicTickRunning = true;
 
     for (;;)
     {
         timeServer_notify_wait();
 
+        // periodic ticks and one-shot wakeups both wake up the network stack
         event_tick_emit();
     }
 }
@@ -41,13 +80,37 @@ proxy_timeServer_rpc_time(uint64_t* ns)
 OS_Error_t
 proxy_timeServer_rpc_oneshot_relative(int id, uint64_t ns)
 {
-    return OS_ERROR_NOT_IMPLEMENTED;
+    if ((PROXY_TIMER_ID_ONESHOT != id) && (PROXY_TIMER_ID_WAKEUP != id))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = timeServer_rpc_oneshot_relative(TICKER_TIMER_ID_ONESHOT,
+                                                     ns);
+    if ((OS_SUCCESS == err) && (PROXY_TIMER_ID_ONESHOT == id))
+    {
+        stop_periodic_tick();
+    }
+
+    return err;
 }
 
 OS_Error_t
 proxy_timeServer_rpc_oneshot_absolute(int id, uint64_t ns)
 {
-    return OS_ERROR_NOT_IMPLEMENTED;
+    if ((PROXY_TIMER_ID_ONESHOT != id) && (PROXY_TIMER_ID_WAKEUP != id))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    OS_Error_t err = timeServer_rpc_oneshot_absolute(TICKER_TIMER_ID_ONESHOT,
+                                                     ns);
+    if ((OS_SUCCESS == err) && (PROXY_TIMER_ID_ONESHOT == id))
+    {
+        stop_periodic_tick();
+    }
+
+    return err;
 }
 
 OS_Error_t
@@ -59,7 +122,12 @@ proxy_timeServer_rpc_periodic(int id, uint64_t ns)
 OS_Error_t
 proxy_timeServer_rpc_stop(int id)
 {
-    return OS_ERROR_NOT_IMPLEMENTED;
+    if ((PROXY_TIMER_ID_ONESHOT != id) && (PROXY_TIMER_ID_WAKEUP != id))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    return timeServer_rpc_stop(TICKER_TIMER_ID_ONESHOT);
 }
 
 OS_Error_t
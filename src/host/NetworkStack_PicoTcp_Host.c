@@ -0,0 +1,1009 @@
+/*
+ * Network Stack host (Linux) environment
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "OS_Dataport.h"
+#include "OS_Error.h"
+#include "OS_Socket.h"
+
+#include "lib_debug/Debug.h"
+
+#include "if_NetworkStack_PicoTcp_NicBatch.h"
+#include "network_stack_core.h"
+#include "network_stack_host.h"
+#include "network_stack_profile.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Same badge numbering as the CAmkES component uses.
+#define MIN_BADGE_ID 101
+
+// Interval of the periodic tick, as long as the stack does not schedule its
+// wakeups itself. This is what the Ticker component does on the target.
+#define HOST_TICK_MS 1000
+
+// Number of frames that can be queued for reception
+#define HOST_NIC_RX_QUEUE_SIZE      1024
+
+// Number of RX ring elements the NIC -> stack dataport is sized for, it holds
+// the RX ring in NetworkStack_Host_NIC_RING mode
+#define HOST_NIC_FROM_PORT_ELEMENTS 16
+
+#define HOST_NIC_TO_PORT_SIZE       (64 * 1024)
+
+static volatile OS_NetworkStack_State_t currentState = UNINITIALIZED;
+
+static NetworkStack_Host_Config_t hostCfg;
+static OS_NetworkStack_AddressConfig_t ipAddrConfig;
+
+// client the calling thread acts as, see NetworkStack_Host_setClient()
+static __thread int currentClient = -1;
+
+static void* clientBufs[NetworkStack_Host_MAX_CLIENTS];
+
+static pthread_t controlThread;
+
+//------------------------------------------------------------------------------
+// Mutexes
+//------------------------------------------------------------------------------
+
+#define HOST_MUTEX_DEFINE(_name_)                                              \
+    static pthread_mutex_t _name_ = PTHREAD_MUTEX_INITIALIZER;                 \
+                                                                               \
+    static int                                                                 \
+    _name_##_lock(void)                                                        \
+    {                                                                          \
+        return pthread_mutex_lock(&_name_);                                    \
+    }                                                                          \
+                                                                               \
+    static int                                                                 \
+    _name_##_unlock(void)                                                      \
+    {                                                                          \
+        return pthread_mutex_unlock(&_name_);                                  \
+    }
+
+HOST_MUTEX_DEFINE(allocatorMutex)
+HOST_MUTEX_DEFINE(nwstackMutex)
+HOST_MUTEX_DEFINE(socketControlBlockMutex)
+HOST_MUTEX_DEFINE(stackThreadSafeMutex)
+
+NetworkStack_PROFILE_MUTEX_DEFINE(allocatorMutex,
+                                  NetworkStack_PicoTcp_MUTEX_ALLOCATOR)
+NetworkStack_PROFILE_MUTEX_DEFINE(nwstackMutex,
+                                  NetworkStack_PicoTcp_MUTEX_NWSTACK)
+
+// CAmkES runs all RPCs of an interface on one thread, one after the other, so
+// the RPC entry points take a mutex per interface to behave the same.
+HOST_MUTEX_DEFINE(socketRpcMutex)
+HOST_MUTEX_DEFINE(socketBatchRpcMutex)
+
+//------------------------------------------------------------------------------
+// Main loop events
+//------------------------------------------------------------------------------
+
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            isPending;
+    bool            isTickless;
+    struct timespec deadline;
+} loopEvent =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+//------------------------------------------------------------------------------
+static struct timespec
+timespec_from_now(
+    uint64_t ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    ts.tv_sec  += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+// see NIC stand-in
+static bool
+nic_rx_ring_refill(void);
+
+//------------------------------------------------------------------------------
+static void
+loop_wait(void)
+{
+    // The stack may have released RX ring slots in the last tick. The driver
+    // stand-in has no thread of its own, so the slots are refilled here.
+    const bool isRefilled = nic_rx_ring_refill();
+
+    pthread_mutex_lock(&loopEvent.mutex);
+
+    while (!loopEvent.isPending && !isRefilled)
+    {
+        if (pthread_cond_timedwait(&loopEvent.cond, &loopEvent.mutex,
+                                   &loopEvent.deadline) == ETIMEDOUT)
+        {
+            // Without scheduled wakeups there is the periodic tick, with them
+            // nothing happens until the stack schedules the next one.
+            loopEvent.deadline = timespec_from_now(
+                                     loopEvent.isTickless ?
+                                     3600 * 1000 : HOST_TICK_MS);
+            break;
+        }
+    }
+    loopEvent.isPending = false;
+
+    pthread_mutex_unlock(&loopEvent.mutex);
+}
+
+//------------------------------------------------------------------------------
+static void
+loop_notify(void)
+{
+    pthread_mutex_lock(&loopEvent.mutex);
+    loopEvent.isPending = true;
+    pthread_cond_signal(&loopEvent.cond);
+    pthread_mutex_unlock(&loopEvent.mutex);
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+loop_schedule(
+    uint64_t ms)
+{
+    pthread_mutex_lock(&loopEvent.mutex);
+#if defined(NetworkStack_PicoTcp_USE_TICKLESS)
+    loopEvent.isTickless = true;
+#else
+    // held back client notifications, picoTCP still needs the periodic tick
+#endif
+    loopEvent.deadline   = timespec_from_now(ms);
+    pthread_cond_signal(&loopEvent.cond);
+    pthread_mutex_unlock(&loopEvent.mutex);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Client notifications
+//------------------------------------------------------------------------------
+
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    unsigned int    pending;
+} clientEvents[NetworkStack_Host_MAX_CLIENTS];
+
+//------------------------------------------------------------------------------
+static void
+client_notify(
+    int clientIndex)
+{
+    pthread_mutex_lock(&clientEvents[clientIndex].mutex);
+    clientEvents[clientIndex].pending++;
+    pthread_cond_signal(&clientEvents[clientIndex].cond);
+    pthread_mutex_unlock(&clientEvents[clientIndex].mutex);
+}
+
+#define HOST_CLIENT_NOTIFY_DEFINE(_n_)                                         \
+    static void                                                                \
+    client_notify_##_n_(void)                                                  \
+    {                                                                          \
+        client_notify(_n_);                                                    \
+    }
+
+HOST_CLIENT_NOTIFY_DEFINE(0)
+HOST_CLIENT_NOTIFY_DEFINE(1)
+HOST_CLIENT_NOTIFY_DEFINE(2)
+HOST_CLIENT_NOTIFY_DEFINE(3)
+HOST_CLIENT_NOTIFY_DEFINE(4)
+HOST_CLIENT_NOTIFY_DEFINE(5)
+HOST_CLIENT_NOTIFY_DEFINE(6)
+HOST_CLIENT_NOTIFY_DEFINE(7)
+
+//------------------------------------------------------------------------------
+// NIC stand-in
+//------------------------------------------------------------------------------
+
+static OS_NetworkStack_RxBuffer_t nicFromPortBuf[HOST_NIC_FROM_PORT_ELEMENTS];
+static void* nicFromPort = nicFromPortBuf;
+
+static uint8_t nicToPortBuf[HOST_NIC_TO_PORT_SIZE];
+static void* nicToPort = nicToPortBuf;
+
+// Frames queued for reception. In NetworkStack_Host_NIC_RING mode they are
+// moved into the RX ring as soon as the stack has released a slot.
+static struct
+{
+    pthread_mutex_t mutex;
+    size_t head;
+    size_t count;
+    size_t ringPos; // next RX ring slot to fill
+    OS_NetworkStack_RxBuffer_t frames[HOST_NIC_RX_QUEUE_SIZE];
+} nicRx =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+//------------------------------------------------------------------------------
+// Drop the frame at the head of the receive queue, caller must hold the mutex
+static void
+nic_rx_queue_pop(void)
+{
+    nicRx.head = (nicRx.head + 1) % HOST_NIC_RX_QUEUE_SIZE;
+    nicRx.count--;
+}
+
+//------------------------------------------------------------------------------
+// Move queued frames into free RX ring slots, in ring order like a driver does.
+// Returns true if any frame was moved.
+static bool
+nic_rx_ring_refill(void)
+{
+    bool isMoved = false;
+
+    if (hostCfg.nic_mode != NetworkStack_Host_NIC_RING)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&nicRx.mutex);
+
+    while (nicRx.count > 0)
+    {
+        OS_NetworkStack_RxBuffer_t* slot = &nicFromPortBuf[nicRx.ringPos];
+
+        // the stack sets the length to 0 once it has released the slot
+        if (__atomic_load_n(&slot->len, __ATOMIC_ACQUIRE) != 0)
+        {
+            break;
+        }
+
+        const OS_NetworkStack_RxBuffer_t* frame = &nicRx.frames[nicRx.head];
+        memcpy(slot->data, frame->data, frame->len);
+        __atomic_store_n(&slot->len, frame->len, __ATOMIC_RELEASE);
+
+        nic_rx_queue_pop();
+        nicRx.ringPos = (nicRx.ringPos + 1) % HOST_NIC_FROM_PORT_ELEMENTS;
+        isMoved = true;
+    }
+
+    pthread_mutex_unlock(&nicRx.mutex);
+
+    return isMoved;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_rx_data(
+    size_t* pLen,
+    size_t* framesRemaining)
+{
+    // a driver with an RX ring does not implement the event based interface
+    if (hostCfg.nic_mode == NetworkStack_Host_NIC_RING)
+    {
+        return OS_ERROR_NOT_IMPLEMENTED;
+    }
+
+    pthread_mutex_lock(&nicRx.mutex);
+
+    if (0 == nicRx.count)
+    {
+        *framesRemaining = 0;
+        pthread_mutex_unlock(&nicRx.mutex);
+        return OS_ERROR_NO_DATA;
+    }
+
+    // the event based interface expects the frame at the dataport start
+    const OS_NetworkStack_RxBuffer_t* frame = &nicRx.frames[nicRx.head];
+    memcpy(nicFromPortBuf, frame->data, frame->len);
+    *pLen = frame->len;
+
+    nic_rx_queue_pop();
+    *framesRemaining = nicRx.count;
+
+    pthread_mutex_unlock(&nicRx.mutex);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_rx_data_batch(
+    size_t  maxFrames,
+    size_t* pFrames,
+    size_t* framesRemaining)
+{
+    uint8_t* base = (uint8_t*)nicFromPortBuf;
+    NetworkStack_PicoTcp_NicBatch_t* batch =
+        (NetworkStack_PicoTcp_NicBatch_t*)base;
+    size_t used = sizeof(*batch);
+
+    if (hostCfg.nic_mode != NetworkStack_Host_NIC_BATCH)
+    {
+        return OS_ERROR_NOT_IMPLEMENTED;
+    }
+
+    if (maxFrames > NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES)
+    {
+        maxFrames = NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES;
+    }
+
+    pthread_mutex_lock(&nicRx.mutex);
+
+    if (0 == nicRx.count)
+    {
+        *pFrames = 0;
+        *framesRemaining = 0;
+        pthread_mutex_unlock(&nicRx.mutex);
+        return OS_ERROR_NO_DATA;
+    }
+
+    size_t frames = 0;
+    while ((frames < maxFrames) && (nicRx.count > 0))
+    {
+        const OS_NetworkStack_RxBuffer_t* frame = &nicRx.frames[nicRx.head];
+        if (frame->len > sizeof(nicFromPortBuf) - used)
+        {
+            break;
+        }
+
+        memcpy(&base[used], frame->data, frame->len);
+        batch->desc[frames].offset = used;
+        batch->desc[frames].len    = frame->len;
+        used += frame->len;
+        frames++;
+
+        nic_rx_queue_pop();
+    }
+
+    *pFrames = frames;
+    *framesRemaining = nicRx.count;
+
+    pthread_mutex_unlock(&nicRx.mutex);
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_tx_data(
+    size_t* pLen)
+{
+    if (*pLen > sizeof(nicToPortBuf))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (NULL != hostCfg.tx)
+    {
+        hostCfg.tx(hostCfg.tx_ctx, nicToPortBuf, *pLen);
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_tx_data_batch(
+    size_t frames)
+{
+    const NetworkStack_PicoTcp_NicBatch_t* batch =
+        (const NetworkStack_PicoTcp_NicBatch_t*)nicToPortBuf;
+
+    if (hostCfg.nic_mode != NetworkStack_Host_NIC_BATCH)
+    {
+        return OS_ERROR_NOT_IMPLEMENTED;
+    }
+
+    if (frames > NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES)
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    // either all frames are taken over or none
+    for (size_t i = 0; i < frames; i++)
+    {
+        const size_t offset = batch->desc[i].offset;
+        const size_t len    = batch->desc[i].len;
+
+        if ((offset < sizeof(*batch)) || (offset > sizeof(nicToPortBuf))
+            || (len > sizeof(nicToPortBuf) - offset))
+        {
+            return OS_ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    for (size_t i = 0; (i < frames) && (NULL != hostCfg.tx); i++)
+    {
+        hostCfg.tx(hostCfg.tx_ctx, &nicToPortBuf[batch->desc[i].offset],
+                   batch->desc[i].len);
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+nic_get_mac_address(void)
+{
+    memcpy(nicFromPortBuf[0].data, hostCfg.mac, sizeof(hostCfg.mac));
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_receiveFrame(
+    const void* frame,
+    size_t      len)
+{
+    if (len > sizeof(nicRx.frames[0].data))
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    pthread_mutex_lock(&nicRx.mutex);
+
+    if (HOST_NIC_RX_QUEUE_SIZE == nicRx.count)
+    {
+        pthread_mutex_unlock(&nicRx.mutex);
+        return OS_ERROR_TRY_AGAIN;
+    }
+
+    OS_NetworkStack_RxBuffer_t* slot =
+        &nicRx.frames[(nicRx.head + nicRx.count) % HOST_NIC_RX_QUEUE_SIZE];
+    memcpy(slot->data, frame, len);
+    slot->len = len;
+    nicRx.count++;
+
+    pthread_mutex_unlock(&nicRx.mutex);
+
+    nic_rx_ring_refill();
+
+    // this is what the NIC driver's notification does on the target
+    loop_notify();
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Functions the CAmkES component provides on the target
+//------------------------------------------------------------------------------
+
+OS_NetworkStack_State_t
+networkStack_getState(void)
+{
+    return currentState;
+}
+
+int
+get_client_id(void)
+{
+    return (currentClient < 0) ? -1 : MIN_BADGE_ID + currentClient;
+}
+
+uint8_t*
+get_client_id_buf(void)
+{
+    return (currentClient < 0) ? NULL : clientBufs[currentClient];
+}
+
+int
+get_client_id_buf_size(void)
+{
+    return (currentClient < 0) ? 0 : hostCfg.client_buf_size;
+}
+
+//------------------------------------------------------------------------------
+// While a snapshot is taken, Timer_getTimeMs() returns the snapshot time, see
+// the CAmkES component.
+static struct
+{
+    bool     isSnapshot;
+    uint64_t ms;
+    uint64_t reads;
+    uint64_t rpcsAvoided;
+} timeCache;
+
+uint64_t
+Timer_getTimeMs(void)
+{
+    NetworkStack_STATS_ADD(timeCache.reads, 1);
+
+    if (timeCache.isSnapshot)
+    {
+        NetworkStack_STATS_ADD(timeCache.rpcsAvoided, 1);
+        return timeCache.ms;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+clock_snapshot_take(void)
+{
+    timeCache.isSnapshot = false;
+    __atomic_store_n(&timeCache.ms, Timer_getTimeMs(), __ATOMIC_RELAXED);
+    timeCache.isSnapshot = true;
+}
+
+void
+clock_snapshot_release(void)
+{
+    timeCache.isSnapshot = false;
+}
+
+uint64_t
+clock_snapshot_get(void)
+{
+    return __atomic_load_n(&timeCache.ms, __ATOMIC_RELAXED);
+}
+
+void
+clock_get_statistics(
+    NetworkStack_PicoTcp_ClockStatistics_t* stats)
+{
+    stats->reads       = NetworkStack_STATS_GET(timeCache.reads);
+    stats->rpcsAvoided = NetworkStack_STATS_GET(timeCache.rpcsAvoided);
+}
+
+//------------------------------------------------------------------------------
+// Command completion
+//------------------------------------------------------------------------------
+
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+} commandDone =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond  = PTHREAD_COND_INITIALIZER,
+};
+
+//------------------------------------------------------------------------------
+static void
+command_wait(
+    const bool* done)
+{
+    pthread_mutex_lock(&commandDone.mutex);
+    while (!__atomic_load_n(done, __ATOMIC_ACQUIRE))
+    {
+        pthread_cond_wait(&commandDone.cond, &commandDone.mutex);
+    }
+    pthread_mutex_unlock(&commandDone.mutex);
+}
+
+//------------------------------------------------------------------------------
+// Several threads may wait, each for its own command.
+static void
+command_notify(void)
+{
+    pthread_mutex_lock(&commandDone.mutex);
+    pthread_cond_broadcast(&commandDone.cond);
+    pthread_mutex_unlock(&commandDone.mutex);
+}
+
+//------------------------------------------------------------------------------
+static uint64_t
+get_timestamp_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Host environment interface
+//------------------------------------------------------------------------------
+
+static NetworkStack_SocketResources_t
+sockets[NetworkStack_PicoTcp_MAX_SOCKETS];
+
+static NetworkStack_Client_t clients[NetworkStack_Host_MAX_CLIENTS];
+
+static const NetworkStack_CamkesConfig_t camkesConfig =
+{
+    .wait_loop_event         = loop_wait,
+
+    .internal =
+    {
+        .notify_loop        = loop_notify,
+        .schedule_loop      = loop_schedule,
+        .get_timestamp      = get_timestamp_ns,
+        .wait_command       = command_wait,
+        .notify_command     = command_notify,
+
+        .allocator_lock     = allocatorMutex_profiled_lock,
+        .allocator_unlock   = allocatorMutex_profiled_unlock,
+
+        .nwStack_lock       = nwstackMutex_profiled_lock,
+        .nwStack_unlock     = nwstackMutex_profiled_unlock,
+
+        .socketCB_lock      = socketControlBlockMutex_lock,
+        .socketCB_unlock    = socketControlBlockMutex_unlock,
+
+        .stackTS_lock       = stackThreadSafeMutex_lock,
+        .stackTS_unlock     = stackThreadSafeMutex_unlock,
+
+        .number_of_clients  = NetworkStack_Host_MAX_CLIENTS,
+        .number_of_sockets  = NetworkStack_PicoTcp_MAX_SOCKETS,
+
+        .sockets            = sockets,
+        .clients            = clients
+    },
+
+    .drv_nic =
+    {
+        .from = OS_DATAPORT_ASSIGN_SIZE(nicFromPort, HOST_NIC_FROM_PORT_ELEMENTS),
+        .to   = OS_DATAPORT_ASSIGN_SIZE(nicToPort, HOST_NIC_TO_PORT_SIZE),
+
+        .rpc =
+        {
+            .dev_read        = nic_rx_data,
+            .dev_read_batch  = nic_rx_data_batch,
+            .dev_write       = nic_tx_data,
+            .dev_write_batch = nic_tx_data_batch,
+            .get_mac         = nic_get_mac_address,
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+static void*
+control_thread(
+    void* arg)
+{
+    OS_Error_t ret = NetworkStack_run();
+
+    Debug_LOG_ERROR("NetworkStack_run() terminated, error %d", ret);
+    currentState = FATAL_ERROR;
+
+    return NULL;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_start(
+    const NetworkStack_Host_Config_t*      hostConfig,
+    const OS_NetworkStack_AddressConfig_t* config)
+{
+    static const event_notify_func_t notifications[NetworkStack_Host_MAX_CLIENTS] =
+    {
+        client_notify_0,
+        client_notify_1,
+        client_notify_2,
+        client_notify_3,
+        client_notify_4,
+        client_notify_5,
+        client_notify_6,
+        client_notify_7
+    };
+
+    if ((NULL == hostConfig) || (NULL == config))
+    {
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    if ((hostConfig->number_of_clients < 1)
+        || (hostConfig->number_of_clients > NetworkStack_Host_MAX_CLIENTS))
+    {
+        Debug_LOG_ERROR("Unsupported number of clients %d",
+                        hostConfig->number_of_clients);
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    if (currentState != UNINITIALIZED)
+    {
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    hostCfg = *hostConfig;
+    ipAddrConfig = *config;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&loopEvent.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    loopEvent.deadline = timespec_from_now(HOST_TICK_MS);
+
+    for (int i = 0; i < hostCfg.number_of_clients; i++)
+    {
+        clientBufs[i] = calloc(1, hostCfg.client_buf_size);
+        if (NULL == clientBufs[i])
+        {
+            Debug_LOG_ERROR("Failed to allocate dataport for client %d", i);
+            return OS_ERROR_INSUFFICIENT_SPACE;
+        }
+
+        pthread_mutex_init(&clientEvents[i].mutex, NULL);
+        pthread_cond_init(&clientEvents[i].cond, NULL);
+
+        clients[i].needsToBeNotified = false;
+        clients[i].inUse = true;
+        clients[i].clientId = MIN_BADGE_ID + i;
+        clients[i].socketQuota = hostCfg.socket_quota;
+        clients[i].notifyHoldoffUs = hostCfg.notify_holdoff_us;
+        clients[i].notifyEventThreshold = hostCfg.notify_event_threshold;
+        clients[i].currentSocketsInUse = 0;
+        clients[i].readyHead = -1;
+        clients[i].readyTail = -1;
+        clients[i].readyCount = 0;
+        clients[i].eventNotify = notifications[i];
+    }
+
+    OS_Error_t ret = NetworkStack_init(&camkesConfig, &ipAddrConfig);
+    if (ret != OS_SUCCESS)
+    {
+        Debug_LOG_ERROR("NetworkStack_init() failed, error %d", ret);
+        return ret;
+    }
+
+    currentState = RUNNING;
+
+    if (pthread_create(&controlThread, NULL, control_thread, NULL) != 0)
+    {
+        Debug_LOG_ERROR("Failed to create control thread");
+        currentState = FATAL_ERROR;
+        return OS_ERROR_GENERIC;
+    }
+
+    return OS_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+void
+NetworkStack_Host_setClient(
+    int clientIndex)
+{
+    currentClient = clientIndex;
+}
+
+//------------------------------------------------------------------------------
+void*
+NetworkStack_Host_getClientBuf(
+    int clientIndex)
+{
+    if ((clientIndex < 0) || (clientIndex >= hostCfg.number_of_clients))
+    {
+        return NULL;
+    }
+
+    return clientBufs[clientIndex];
+}
+
+//------------------------------------------------------------------------------
+void
+NetworkStack_Host_waitClientEvent(
+    int clientIndex)
+{
+    pthread_mutex_lock(&clientEvents[clientIndex].mutex);
+    while (0 == clientEvents[clientIndex].pending)
+    {
+        pthread_cond_wait(&clientEvents[clientIndex].cond,
+                          &clientEvents[clientIndex].mutex);
+    }
+    clientEvents[clientIndex].pending = 0;
+    pthread_mutex_unlock(&clientEvents[clientIndex].mutex);
+}
+
+//------------------------------------------------------------------------------
+// Socket RPCs
+//------------------------------------------------------------------------------
+
+// Entry points of the core, on the target they are declared by the CAmkES
+// glue code and called by the RPC threads.
+OS_Error_t
+networkStack_rpc_socket_create(
+    const int  domain,
+    const int  socket_type,
+    int* const pHandle);
+
+OS_Error_t
+networkStack_rpc_socket_close(
+    const int handle);
+
+OS_Error_t
+networkStack_rpc_socket_connect(
+    const int                     handle,
+    const OS_Socket_Addr_t* const dstAddr);
+
+OS_Error_t
+networkStack_rpc_socket_bind(
+    const int                     handle,
+    const OS_Socket_Addr_t* const localAddr);
+
+OS_Error_t
+networkStack_rpc_socket_listen(
+    const int handle,
+    const int backlog);
+
+OS_Error_t
+networkStack_rpc_socket_accept(
+    const int               handle,
+    int* const              pClient_handle,
+    OS_Socket_Addr_t* const srcAddr);
+
+OS_Error_t
+networkStack_rpc_socket_write(
+    const int     handle,
+    size_t* const pLen);
+
+OS_Error_t
+networkStack_rpc_socket_read(
+    const int     handle,
+    size_t* const pLen);
+
+OS_Error_t
+networkStack_rpc_socket_sendto(
+    const int                     handle,
+    size_t* const                 pLen,
+    const OS_Socket_Addr_t* const dstAddr);
+
+OS_Error_t
+networkStack_rpc_socket_recvfrom(
+    const int               handle,
+    size_t* const           pLen,
+    OS_Socket_Addr_t* const srcAddr);
+
+OS_Error_t
+networkStack_rpc_socket_getPendingEvents(
+    const size_t  maxRequestedSize,
+    size_t* const pNumberOfEvents);
+
+// Runs an RPC of the interface whose mutex is given, see socketRpcMutex
+#define HOST_RPC_CALL(_interface_, _call_)                                     \
+    do                                                                         \
+    {                                                                          \
+        _interface_##_lock();                                                  \
+        const OS_Error_t _ret_ = _call_;                                       \
+        _interface_##_unlock();                                                \
+        return _ret_;                                                          \
+    } while (0)
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_create(
+    const int  domain,
+    const int  socket_type,
+    int* const pHandle)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_create(domain, socket_type, pHandle));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_close(
+    const int handle)
+{
+    HOST_RPC_CALL(socketRpcMutex, networkStack_rpc_socket_close(handle));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_connect(
+    const int                     handle,
+    const OS_Socket_Addr_t* const dstAddr)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_connect(handle, dstAddr));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_bind(
+    const int                     handle,
+    const OS_Socket_Addr_t* const localAddr)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_bind(handle, localAddr));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_listen(
+    const int handle,
+    const int backlog)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_listen(handle, backlog));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_accept(
+    const int               handle,
+    int* const              pClient_handle,
+    OS_Socket_Addr_t* const srcAddr)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_accept(handle, pClient_handle,
+                                                 srcAddr));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_acceptMany(
+    const int  handle,
+    const int  max,
+    int* const pAccepted)
+{
+    HOST_RPC_CALL(socketBatchRpcMutex,
+                  networkStack_rpc_socket_acceptMany(handle, max, pAccepted));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_write(
+    const int     handle,
+    size_t* const pLen)
+{
+    HOST_RPC_CALL(socketRpcMutex, networkStack_rpc_socket_write(handle, pLen));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_read(
+    const int     handle,
+    size_t* const pLen)
+{
+    HOST_RPC_CALL(socketRpcMutex, networkStack_rpc_socket_read(handle, pLen));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_sendto(
+    const int                     handle,
+    size_t* const                 pLen,
+    const OS_Socket_Addr_t* const dstAddr)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_sendto(handle, pLen, dstAddr));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_recvfrom(
+    const int               handle,
+    size_t* const           pLen,
+    OS_Socket_Addr_t* const srcAddr)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_recvfrom(handle, pLen, srcAddr));
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_Host_socket_getPendingEvents(
+    const size_t  maxRequestedSize,
+    size_t* const pNumberOfEvents)
+{
+    HOST_RPC_CALL(socketRpcMutex,
+                  networkStack_rpc_socket_getPendingEvents(maxRequestedSize,
+                                                           pNumberOfEvents));
+}
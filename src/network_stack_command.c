@@ -0,0 +1,98 @@
+/*
+ * Network Stack command queue
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "network_stack_command.h"
+#include "network_stack_config.h"
+#include "network_stack_profile.h"
+
+#include <stddef.h>
+
+#if defined(NetworkStack_PicoTcp_USE_COMMAND_QUEUE)
+
+// Any thread pushes its command onto this lock-free stack. The stack thread
+// takes all of them at once, so there is no ABA problem, and reverses them to
+// run them in the order they arrived.
+static NetworkStack_Command_t* pending = NULL;
+
+//------------------------------------------------------------------------------
+void
+network_stack_command_execute(
+    NetworkStack_Command_t* command)
+{
+    NetworkStack_PROFILE_START(start);
+
+    command->done = false;
+    command->next = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&pending, &command->next, command,
+                                        true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+    {
+        // command->next was updated to the current head, try again
+    }
+
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
+    internal_wait_command_done(&command->done);
+
+    // the stack thread holds the thread safety mutex for the command, so the
+    // whole wait counts as blocked on the stack
+    NetworkStack_PROFILE_COMMAND_DONE(start);
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_command_run_pending(void)
+{
+    NetworkStack_Command_t* command = __atomic_exchange_n(&pending, NULL,
+                                                          __ATOMIC_ACQUIRE);
+    if (NULL == command)
+    {
+        return;
+    }
+
+    NetworkStack_Command_t* fifo = NULL;
+    while (NULL != command)
+    {
+        NetworkStack_Command_t* const next = command->next;
+        command->next = fifo;
+        fifo = command;
+        command = next;
+    }
+
+    while (NULL != fifo)
+    {
+        // the waiting thread may reuse the command once it is done
+        NetworkStack_Command_t* const next = fifo->next;
+
+        fifo->run(fifo);
+        __atomic_store_n(&fifo->done, true, __ATOMIC_RELEASE);
+
+        fifo = next;
+    }
+
+    internal_notify_command_done();
+}
+
+#else
+
+//------------------------------------------------------------------------------
+void
+network_stack_command_execute(
+    NetworkStack_Command_t* command)
+{
+    command->run(command);
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_command_run_pending(void)
+{
+    // nothing is ever queued
+}
+
+#endif // NetworkStack_PicoTcp_USE_COMMAND_QUEUE
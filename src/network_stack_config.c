@@ -13,7 +13,9 @@
 
 #include "network_stack_config.h"
 #include "network_stack_core.h"
+#include "network_stack_profile.h"
 
+#include <inttypes.h>
 #include <stddef.h>
 
 //------------------------------------------------------------------------------
@@ -35,9 +37,17 @@ wait_network_event(void)
 }
 
 
+// Reasons of a loop wakeup that is signaled but not picked up by the loop
+// yet, a wakeup is pending as long as any bit is set. Any thread may signal a
+// wakeup, so the reasons and the counters are atomic.
+static uint32_t loopWakeReasons = 0;
+static uint64_t wakeupsDelivered  = 0;
+static uint64_t wakeupsSuppressed = 0;
+
 //------------------------------------------------------------------------------
 void
-internal_notify_main_loop(void)
+internal_notify_main_loop(
+    NetworkStack_PicoTcp_WakeReason_t reason)
 {
     Debug_LOG_TRACE("internal_notify_main_loop for handle");
 
@@ -50,10 +60,64 @@ internal_notify_main_loop(void)
         return;
     }
 
+    // The loop picks up everything done before the pending wakeup, as it
+    // takes the reasons before it starts processing. So another wakeup is not
+    // needed then.
+    if (__atomic_fetch_or(&loopWakeReasons, 1U << reason, __ATOMIC_ACQ_REL))
+    {
+        __atomic_fetch_add(&wakeupsSuppressed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&wakeupsDelivered, 1, __ATOMIC_RELAXED);
     do_notify();
 }
 
 
+//------------------------------------------------------------------------------
+uint32_t
+internal_take_main_loop_wake_reasons(void)
+{
+    // acquire pairs with the release of the fetch_or in
+    // internal_notify_main_loop()
+    return __atomic_exchange_n(&loopWakeReasons, 0, __ATOMIC_ACQ_REL);
+}
+
+
+//------------------------------------------------------------------------------
+void
+internal_get_loop_statistics(
+    NetworkStack_PicoTcp_LoopStatistics_t* stats)
+{
+    stats->wakeupsDelivered  = __atomic_load_n(&wakeupsDelivered,
+                                               __ATOMIC_RELAXED);
+    stats->wakeupsSuppressed = __atomic_load_n(&wakeupsSuppressed,
+                                               __ATOMIC_RELAXED);
+}
+
+
+//------------------------------------------------------------------------------
+void
+internal_schedule_main_loop(uint64_t ms)
+{
+    Debug_LOG_TRACE("internal_schedule_main_loop in %" PRIu64 " ms", ms);
+
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    OS_Error_t (*do_schedule)(uint64_t) = handlers->internal.schedule_loop;
+    if (!do_schedule)
+    {
+        return;
+    }
+
+    OS_Error_t err = do_schedule(ms);
+    if (OS_SUCCESS != err)
+    {
+        Debug_LOG_ERROR("internal.schedule_loop failed, error %d", err);
+    }
+}
+
+
 //------------------------------------------------------------------------------
 const OS_Dataport_t*
 get_nic_port_from(void)
@@ -101,6 +165,25 @@ nic_dev_read(
 }
 
 
+//------------------------------------------------------------------------------
+OS_Error_t
+nic_dev_read_batch(
+    size_t  maxFrames,
+    size_t* pFrames,
+    size_t* frameRemaining)
+{
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    if (NULL == handlers->drv_nic.rpc.dev_read_batch)
+    {
+        return OS_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return handlers->drv_nic.rpc.dev_read_batch(maxFrames, pFrames,
+                                                frameRemaining);
+}
+
+
 //------------------------------------------------------------------------------
 OS_Error_t
 nic_dev_write(
@@ -114,6 +197,22 @@ nic_dev_write(
 }
 
 
+//------------------------------------------------------------------------------
+OS_Error_t
+nic_dev_write_batch(
+    size_t frames)
+{
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    if (NULL == handlers->drv_nic.rpc.dev_write_batch)
+    {
+        return OS_ERROR_NOT_IMPLEMENTED;
+    }
+
+    return handlers->drv_nic.rpc.dev_write_batch(frames);
+}
+
+
 //------------------------------------------------------------------------------
 OS_Error_t
 nic_dev_get_mac_address(void)
@@ -126,6 +225,56 @@ nic_dev_get_mac_address(void)
 }
 
 
+//------------------------------------------------------------------------------
+uint64_t
+internal_get_timestamp(void)
+{
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    uint64_t (*get_timestamp)(void) = handlers->internal.get_timestamp;
+    if (!get_timestamp)
+    {
+        return 0;
+    }
+
+    return get_timestamp();
+}
+
+
+//------------------------------------------------------------------------------
+void
+internal_wait_command_done(const bool* done)
+{
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    void (*do_wait)(const bool*) = handlers->internal.wait_command;
+    if (!do_wait)
+    {
+        Debug_LOG_WARNING("internal.wait_command not set");
+        return;
+    }
+
+    do_wait(done);
+}
+
+
+//------------------------------------------------------------------------------
+void
+internal_notify_command_done(void)
+{
+    const NetworkStack_CamkesConfig_t* handlers = config_get_handlers();
+
+    void (*do_notify)(void) = handlers->internal.notify_command;
+    if (!do_notify)
+    {
+        Debug_LOG_WARNING("internal.notify_command not set");
+        return;
+    }
+
+    do_notify();
+}
+
+
 //------------------------------------------------------------------------------
 void
 internal_socket_control_block_mutex_lock(void)
@@ -140,7 +289,10 @@ internal_socket_control_block_mutex_lock(void)
     }
 
     Debug_LOG_TRACE("%s", __func__);
+    NetworkStack_PROFILE_START(start);
     lock_mutex();
+    NetworkStack_PROFILE_MUTEX_LOCKED(NetworkStack_PicoTcp_MUTEX_SOCKET_CB,
+                                      start);
 }
 
 //------------------------------------------------------------------------------
@@ -156,6 +308,7 @@ void internal_socket_control_block_mutex_unlock(void)
     }
 
     Debug_LOG_TRACE("%s", __func__);
+    NetworkStack_PROFILE_MUTEX_UNLOCK(NetworkStack_PicoTcp_MUTEX_SOCKET_CB);
     unlock_mutex();
 }
 
@@ -172,7 +325,10 @@ void internal_network_stack_thread_safety_mutex_lock(void)
     }
 
     Debug_LOG_TRACE("%s", __func__);
+    NetworkStack_PROFILE_START(start);
     lock_mutex();
+    NetworkStack_PROFILE_MUTEX_LOCKED(NetworkStack_PicoTcp_MUTEX_STACK_TS,
+                                      start);
 }
 
 //------------------------------------------------------------------------------
@@ -188,5 +344,6 @@ void internal_network_stack_thread_safety_mutex_unlock(void)
     }
 
     Debug_LOG_TRACE("%s", __func__);
+    NetworkStack_PROFILE_MUTEX_UNLOCK(NetworkStack_PicoTcp_MUTEX_STACK_TS);
     unlock_mutex();
 }
@@ -11,9 +11,12 @@
 
 #include "lib_macros/Check.h"
 
+#include "network_stack_command.h"
 #include "network_stack_config.h"
 #include "network_stack_core.h"
 #include "network_stack_pico.h"
+#include "network_stack_pico_nic.h"
+#include "network_stack_profile.h"
 
 #include <stdlib.h>
 #include <stdint.h>
@@ -22,6 +25,24 @@
 #define SOCKET_IN_USE 1
 #define CONNECTED 1
 
+// The reverse index from implementation sockets to handles is an open
+// addressing hash table with linear probing. It has twice as many slots as
+// there are sockets, so the load factor never exceeds 0.5.
+#define IMPL_SOCKET_INDEX_SIZE      (2 * NetworkStack_PicoTcp_MAX_SOCKETS)
+#define IMPL_SOCKET_INDEX_EMPTY     -1
+#define IMPL_SOCKET_INDEX_DELETED   -2
+
+// Handles carry the socket table index in the lower bits and the generation
+// of the slot in the upper bits, so a handle of a closed socket does not
+// match any more once its slot got reused.
+#define SOCKET_HANDLE_INDEX_BITS        16
+#define SOCKET_HANDLE_INDEX_MASK        ((1 << SOCKET_HANDLE_INDEX_BITS) - 1)
+#define SOCKET_HANDLE_GENERATION_MASK   0x7fff
+
+_Static_assert(NetworkStack_PicoTcp_MAX_SOCKETS
+               <= SOCKET_HANDLE_INDEX_MASK + 1,
+               "socket index does not fit into a handle");
+
 // TODO: The implementation for this function is provided by the implementing
 // NetworkStack component. This should be reworked so that we do not have this
 // close coupling here and move the whole state management to the implementing
@@ -31,6 +52,12 @@ extern OS_NetworkStack_State_t networkStack_getState();
 // network stack state
 static NetworkStack_t instance = {0};
 
+// Slots hold a socket table index or one of the IMPL_SOCKET_INDEX_xxx markers.
+// Deleted slots are only marked, so a lookup running concurrently with
+// free_handle() never misses an entry that is still valid.
+static int implSocketIndex[IMPL_SOCKET_INDEX_SIZE];
+static int implSocketIndexDeleted = 0;
+
 //------------------------------------------------------------------------------
 const NetworkStack_CamkesConfig_t*
 config_get_handlers(void)
@@ -43,6 +70,118 @@ config_get_handlers(void)
 }
 
 
+//------------------------------------------------------------------------------
+// Socket commands
+//------------------------------------------------------------------------------
+
+typedef enum
+{
+    SOCKET_COMMAND_CREATE,
+    SOCKET_COMMAND_CLOSE,
+    SOCKET_COMMAND_CONNECT,
+    SOCKET_COMMAND_BIND,
+    SOCKET_COMMAND_LISTEN,
+    SOCKET_COMMAND_ACCEPT,
+    SOCKET_COMMAND_ACCEPT_MANY,
+    SOCKET_COMMAND_WRITE,
+    SOCKET_COMMAND_READ,
+    SOCKET_COMMAND_SENDTO,
+    SOCKET_COMMAND_RECVFROM
+} SocketCommandType_t;
+
+// Call of the picoTCP wrapper, all arguments that depend on the calling client
+// are resolved before, as the command may run on the stack thread.
+typedef struct
+{
+    NetworkStack_Command_t command; // must be first
+
+    SocketCommandType_t     type;
+    int                     handle;
+    int                     clientId;
+    int                     domain;
+    int                     socketType;
+    int                     backlog;
+    int                     max;
+    int*                    pHandle;
+    void*                   buf;
+    int                     bufSize;
+    size_t*                 pLen;
+    const OS_Socket_Addr_t* dstAddr;
+    OS_Socket_Addr_t*       srcAddr;
+
+    OS_Error_t              ret;
+} SocketCommand_t;
+
+//------------------------------------------------------------------------------
+static void
+socket_command_run(
+    NetworkStack_Command_t* command)
+{
+    SocketCommand_t* const cmd = (SocketCommand_t*)command;
+
+    switch (cmd->type)
+    {
+    case SOCKET_COMMAND_CREATE:
+        cmd->ret = network_stack_pico_socket_create(cmd->domain,
+                                                    cmd->socketType,
+                                                    cmd->pHandle,
+                                                    cmd->clientId,
+                                                    cmd->buf,
+                                                    cmd->bufSize);
+        break;
+    case SOCKET_COMMAND_CLOSE:
+        cmd->ret = network_stack_pico_socket_close(cmd->handle, cmd->clientId);
+        break;
+    case SOCKET_COMMAND_CONNECT:
+        cmd->ret = network_stack_pico_socket_connect(cmd->handle, cmd->dstAddr);
+        break;
+    case SOCKET_COMMAND_BIND:
+        cmd->ret = network_stack_pico_socket_bind(cmd->handle, cmd->dstAddr);
+        break;
+    case SOCKET_COMMAND_LISTEN:
+        cmd->ret = network_stack_pico_socket_listen(cmd->handle, cmd->backlog);
+        break;
+    case SOCKET_COMMAND_ACCEPT:
+        cmd->ret = network_stack_pico_socket_accept(cmd->handle, cmd->pHandle,
+                                                    cmd->srcAddr);
+        break;
+    case SOCKET_COMMAND_ACCEPT_MANY:
+        cmd->ret = network_stack_pico_socket_acceptMany(cmd->handle, cmd->max,
+                                                        cmd->buf,
+                                                        cmd->pHandle);
+        break;
+    case SOCKET_COMMAND_WRITE:
+        cmd->ret = network_stack_pico_socket_write(cmd->handle, cmd->pLen);
+        break;
+    case SOCKET_COMMAND_READ:
+        cmd->ret = network_stack_pico_socket_read(cmd->handle, cmd->pLen);
+        break;
+    case SOCKET_COMMAND_SENDTO:
+        cmd->ret = network_stack_pico_socket_sendto(cmd->handle, cmd->pLen,
+                                                    cmd->dstAddr);
+        break;
+    case SOCKET_COMMAND_RECVFROM:
+        cmd->ret = network_stack_pico_socket_recvfrom(cmd->handle, cmd->pLen,
+                                                      cmd->srcAddr);
+        break;
+    default:
+        cmd->ret = OS_ERROR_INVALID_PARAMETER;
+        break;
+    }
+}
+
+//------------------------------------------------------------------------------
+static OS_Error_t
+socket_command_execute(
+    SocketCommand_t* cmd)
+{
+    cmd->command.run = socket_command_run;
+    network_stack_command_execute(&cmd->command);
+
+    return cmd->ret;
+}
+
+
 //------------------------------------------------------------------------------
 OS_Error_t
 networkStack_rpc_socket_create(
@@ -50,17 +189,24 @@ networkStack_rpc_socket_create(
     const int  socket_type,
     int* const pHandle)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_CREATE);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     CHECK_PTR_NOT_NULL(pHandle);
 
-    return network_stack_pico_socket_create(
-               domain,
-               socket_type,
-               pHandle,
-               get_client_id(),
-               get_client_id_buf(),
-               get_client_id_buf_size());
+    SocketCommand_t cmd =
+    {
+        .type       = SOCKET_COMMAND_CREATE,
+        .domain     = domain,
+        .socketType = socket_type,
+        .pHandle    = pHandle,
+        .clientId   = get_client_id(),
+        .buf        = get_client_id_buf(),
+        .bufSize    = get_client_id_buf_size()
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -77,7 +223,14 @@ networkStack_rpc_socket_close(
 
     CHECK_CLIENT_ID(socket);
 
-    return network_stack_pico_socket_close(handle, get_client_id());
+    SocketCommand_t cmd =
+    {
+        .type     = SOCKET_COMMAND_CLOSE,
+        .handle   = handle,
+        .clientId = get_client_id()
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -87,6 +240,8 @@ networkStack_rpc_socket_connect(
     const int                     handle,
     const OS_Socket_Addr_t* const dstAddr)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_CONNECT);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -101,7 +256,14 @@ networkStack_rpc_socket_connect(
 
     CHECK_STR_IS_NUL_TERMINATED(dstAddr->addr, 16);
 
-    return network_stack_pico_socket_connect(handle, dstAddr);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_CONNECT,
+        .handle  = handle,
+        .dstAddr = dstAddr
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -123,7 +285,14 @@ networkStack_rpc_socket_bind(
 
     CHECK_STR_IS_NUL_TERMINATED(localAddr->addr, 16);
 
-    return network_stack_pico_socket_bind(handle, localAddr);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_BIND,
+        .handle  = handle,
+        .dstAddr = localAddr
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -143,7 +312,14 @@ networkStack_rpc_socket_listen(
 
     CHECK_CLIENT_ID(socket);
 
-    return network_stack_pico_socket_listen(handle, backlog);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_LISTEN,
+        .handle  = handle,
+        .backlog = backlog
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -156,6 +332,8 @@ networkStack_rpc_socket_accept(
     int* const              pClient_handle,
     OS_Socket_Addr_t* const srcAddr)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_ACCEPT);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -170,7 +348,64 @@ networkStack_rpc_socket_accept(
 
     CHECK_PTR_NOT_NULL(srcAddr);
 
-    return network_stack_pico_socket_accept(handle, pClient_handle, srcAddr);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_ACCEPT,
+        .handle  = handle,
+        .pHandle = pClient_handle,
+        .srcAddr = srcAddr
+    };
+
+    return socket_command_execute(&cmd);
+}
+
+
+//------------------------------------------------------------------------------
+// Accepts several pending connections at once, the records go to the client's
+// dataport
+OS_Error_t
+networkStack_rpc_socket_acceptMany(
+    const int  handle,
+    const int  max,
+    int* const pAccepted)
+{
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_ACCEPT_MANY);
+
+    CHECK_IS_RUNNING(networkStack_getState());
+
+    NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
+
+    CHECK_SOCKET(socket, handle);
+
+    CHECK_SOCKET_TYPE(socket, OS_SOCK_STREAM);
+
+    CHECK_CLIENT_ID(socket);
+
+    CHECK_PTR_NOT_NULL(pAccepted);
+
+    if (max <= 0)
+    {
+        Debug_LOG_ERROR("%s: invalid maximum %d", __func__, max);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+    const int recordsFitting = get_client_id_buf_size()
+                               / sizeof(NetworkStack_PicoTcp_AcceptRecord_t);
+    if (recordsFitting <= 0)
+    {
+        return OS_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_ACCEPT_MANY,
+        .handle  = handle,
+        .max     = (max < recordsFitting) ? max : recordsFitting,
+        .buf     = get_client_id_buf(),
+        .pHandle = pAccepted
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 
@@ -180,6 +415,8 @@ networkStack_rpc_socket_write(
     const int     handle,
     size_t* const pLen)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_WRITE);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -201,7 +438,14 @@ networkStack_rpc_socket_write(
         *pLen = get_client_id_buf_size();
     }
 
-    return network_stack_pico_socket_write(handle, pLen);
+    SocketCommand_t cmd =
+    {
+        .type   = SOCKET_COMMAND_WRITE,
+        .handle = handle,
+        .pLen   = pLen
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 //------------------------------------------------------------------------------
@@ -210,6 +454,8 @@ networkStack_rpc_socket_read(
     const int     handle,
     size_t* const pLen)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_READ);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -231,7 +477,14 @@ networkStack_rpc_socket_read(
         *pLen = get_client_id_buf_size();
     }
 
-    return network_stack_pico_socket_read(handle, pLen);
+    SocketCommand_t cmd =
+    {
+        .type   = SOCKET_COMMAND_READ,
+        .handle = handle,
+        .pLen   = pLen
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 //------------------------------------------------------------------------------
@@ -241,6 +494,8 @@ networkStack_rpc_socket_sendto(
     size_t* const                 pLen,
     const OS_Socket_Addr_t* const dstAddr)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_SENDTO);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -262,7 +517,15 @@ networkStack_rpc_socket_sendto(
         *pLen = get_client_id_buf_size();
     }
 
-    return network_stack_pico_socket_sendto(handle, pLen, dstAddr);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_SENDTO,
+        .handle  = handle,
+        .pLen    = pLen,
+        .dstAddr = dstAddr
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 //------------------------------------------------------------------------------
@@ -272,6 +535,8 @@ networkStack_rpc_socket_recvfrom(
     size_t* const           pLen,
     OS_Socket_Addr_t* const srcAddr)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_RECVFROM);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
@@ -293,7 +558,15 @@ networkStack_rpc_socket_recvfrom(
         *pLen = get_client_id_buf_size();
     }
 
-    return network_stack_pico_socket_recvfrom(handle, pLen, srcAddr);
+    SocketCommand_t cmd =
+    {
+        .type    = SOCKET_COMMAND_RECVFROM,
+        .handle  = handle,
+        .pLen    = pLen,
+        .srcAddr = srcAddr
+    };
+
+    return socket_command_execute(&cmd);
 }
 
 //------------------------------------------------------------------------------
@@ -304,12 +577,110 @@ networkStack_rpc_socket_getStatus(
     return networkStack_getState();
 }
 
+//------------------------------------------------------------------------------
+// build the handle for a socket table index from the slot's generation
+static int
+socket_handle_from_index(
+    const int index)
+{
+    return (instance.sockets[index].generation << SOCKET_HANDLE_INDEX_BITS)
+           | index;
+}
+
+//------------------------------------------------------------------------------
+// get the socket table index for a handle, returns -1 if the handle is invalid
+// or its generation does not match the slot any longer
+static int
+socket_index_from_handle(
+    const int handle)
+{
+    if (handle < 0)
+    {
+        return -1;
+    }
+
+    const int index = handle & SOCKET_HANDLE_INDEX_MASK;
+    if ((index >= instance.number_of_sockets)
+        || (instance.sockets[index].generation
+            != (handle >> SOCKET_HANDLE_INDEX_BITS)))
+    {
+        return -1;
+    }
+
+    return index;
+}
+
+//------------------------------------------------------------------------------
+// append a socket to the ready list of its client, caller must hold the socket
+// control block mutex
+static void
+ready_list_append(
+    NetworkStack_Client_t* const client,
+    const int                    index)
+{
+    NetworkStack_SocketResources_t* const socket = &instance.sockets[index];
+
+    socket->readyPrev = client->readyTail;
+    socket->readyNext = -1;
+    __atomic_store_n(&socket->inReadyList, true, __ATOMIC_RELAXED);
+
+    if (client->readyTail < 0)
+    {
+        client->readyHead = index;
+    }
+    else
+    {
+        instance.sockets[client->readyTail].readyNext = index;
+    }
+    client->readyTail = index;
+    client->readyCount++;
+
+    // the notification pass reminds the client of its pending events
+    __atomic_store_n(&instance.isNotifyPassNeeded, true, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------------
+// remove a socket from the ready list of its client, caller must hold the
+// socket control block mutex
+static void
+ready_list_remove(
+    NetworkStack_Client_t* const client,
+    const int                    index)
+{
+    NetworkStack_SocketResources_t* const socket = &instance.sockets[index];
+
+    if (socket->readyPrev < 0)
+    {
+        client->readyHead = socket->readyNext;
+    }
+    else
+    {
+        instance.sockets[socket->readyPrev].readyNext = socket->readyNext;
+    }
+
+    if (socket->readyNext < 0)
+    {
+        client->readyTail = socket->readyPrev;
+    }
+    else
+    {
+        instance.sockets[socket->readyNext].readyPrev = socket->readyPrev;
+    }
+
+    socket->readyPrev = -1;
+    socket->readyNext = -1;
+    __atomic_store_n(&socket->inReadyList, false, __ATOMIC_RELAXED);
+    client->readyCount--;
+}
+
 //------------------------------------------------------------------------------
 OS_Error_t
 networkStack_rpc_socket_getPendingEvents(
     const size_t  maxRequestedSize,
     size_t* const pNumberOfEvents)
 {
+    NetworkStack_PROFILE_RPC(NetworkStack_PicoTcp_RPC_GET_PENDING_EVENTS);
+
     CHECK_IS_RUNNING(networkStack_getState());
 
     CHECK_PTR_NOT_NULL(pNumberOfEvents);
@@ -342,77 +713,178 @@ networkStack_rpc_socket_getPendingEvents(
         maxSocketsWithEvents = ((clientDataportSize) / sizeof(OS_Socket_Evt_t));
     }
 
+    NetworkStack_Client_t* const client = &instance.clients[clientIndex];
+
     int offset = 0;
     int socketsWithEvents = 0;
 
-    do
-    {
-        int i = instance.clients[clientIndex].head;
+    // The event masks are updated atomically, so harvesting them does not
+    // need the thread safety mutex and never stalls the stack tick. The socket
+    // control block mutex protects the ready list only.
+    internal_socket_control_block_mutex_lock();
 
-        if (instance.sockets[i].clientId == clientId)
+    // Sockets that still have events are queued again at the back, so visit
+    // only the ones that are queued at this point to report each socket once.
+    int socketsToVisit = client->readyCount;
+
+    while ((socketsToVisit > 0) && (socketsWithEvents < maxSocketsWithEvents))
+    {
+        const int i = client->readyHead;
+        ready_list_remove(client, i);
+        socketsToVisit--;
+
+        // Unmask all events that require no follow up communication with the
+        // NetworkStack and should only inform the client about specific
+        // events. Reading and clearing is one operation, so an event set by
+        // the stack thread in between is not lost.
+        const uint16_t eventMask = NetworkStack_EVENTS_CLEAR(
+                                       &instance.sockets[i],
+                                       OS_SOCK_EV_CONN_EST
+                                       | OS_SOCK_EV_WRITE
+                                       | OS_SOCK_EV_ERROR);
+        if (eventMask)
         {
-            if (instance.sockets[i].eventMask)
-            {
-                socketsWithEvents++;
-                OS_Socket_Evt_t event;
-
-                internal_network_stack_thread_safety_mutex_lock();
-                event.eventMask = instance.sockets[i].eventMask;
-                event.socketHandle = i;
-                event.parentSocketHandle = instance.sockets[i].parentHandle;
-                event.currentError = instance.sockets[i].current_error;
-                // Unmask all events that require no follow up communication
-                // with the NetworkStack and should only inform the client about
-                // specific events.
-                instance.sockets[i].eventMask &= ~(OS_SOCK_EV_CONN_EST
-                                                   | OS_SOCK_EV_WRITE
-                                                   | OS_SOCK_EV_ERROR);
-                internal_network_stack_thread_safety_mutex_unlock();
-
-                memcpy(&clientDataport[offset], &event, sizeof(event));
-                offset += sizeof(event);
-            }
+            socketsWithEvents++;
+            OS_Socket_Evt_t event;
+
+            // The parent handle and the error are read without the thread
+            // safety mutex, the stack thread may change them meanwhile. So a
+            // record can combine the event mask with an older or newer parent
+            // handle or error than the event was raised with. Each value is
+            // consistent on its own, the next call reports the current ones.
+            event.eventMask = eventMask;
+            event.socketHandle = socket_handle_from_index(i);
+            event.parentSocketHandle = instance.sockets[i].parentHandle;
+            event.currentError = instance.sockets[i].current_error;
+
+            memcpy(&clientDataport[offset], &event, sizeof(event));
+            offset += sizeof(event);
         }
 
-        instance.clients[clientIndex].head++;
-
-        if (instance.clients[clientIndex].head == instance.number_of_sockets)
+        // Events set after the clear above queue the socket again themselves
+        // once the stack thread gets the mutex.
+        if (eventMask & ~(OS_SOCK_EV_CONN_EST
+                          | OS_SOCK_EV_WRITE
+                          | OS_SOCK_EV_ERROR))
         {
-            instance.clients[clientIndex].head = 0;
+            ready_list_append(client, i);
         }
     }
-    while ((instance.clients[clientIndex].head !=
-            instance.clients[clientIndex].tail)
-           && (socketsWithEvents < maxSocketsWithEvents));
+
+    internal_socket_control_block_mutex_unlock();
 
     // The loop was exited due to the fact that it reached the maximum number of
     // events that were requested by the caller. Signal the caller with the next
     // tick, that events might still be left.
-    if ((socketsWithEvents >= maxSocketsWithEvents)
-        && (instance.clients[clientIndex].head != instance.clients[clientIndex].tail))
+    if (socketsToVisit > 0)
     {
-        instance.clients[clientIndex].needsToBeNotified = true;
+        request_client_notification(client);
     }
 
-    instance.clients[clientIndex].tail = instance.clients[clientIndex].head;
-
     *pNumberOfEvents = socketsWithEvents;
 
     return OS_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+// hash an implementation socket pointer to its home slot in the reverse index
+static unsigned int
+impl_socket_index_hash(
+    const void* impl_sock)
+{
+    // Sockets are heap allocated, so the lowest bits carry no information.
+    const uint32_t key = (uint32_t)((uintptr_t)impl_sock >> 3);
+
+    return (key * 2654435761u) % IMPL_SOCKET_INDEX_SIZE;
+}
+
+//------------------------------------------------------------------------------
+// add a socket table index to the reverse index, caller must hold the socket
+// control block mutex
+static void
+impl_socket_index_insert(
+    const int index)
+{
+    unsigned int pos = impl_socket_index_hash(
+                           instance.sockets[index].implementation_socket);
+
+    // There are more slots than sockets, so there is always a free one.
+    while (implSocketIndex[pos] >= 0)
+    {
+        pos = (pos + 1) % IMPL_SOCKET_INDEX_SIZE;
+    }
+
+    if (implSocketIndex[pos] == IMPL_SOCKET_INDEX_DELETED)
+    {
+        implSocketIndexDeleted--;
+    }
+    implSocketIndex[pos] = index;
+}
+
+//------------------------------------------------------------------------------
+// remove a socket table index from the reverse index, caller must hold the
+// socket control block mutex
+static void
+impl_socket_index_remove(
+    const int index)
+{
+    unsigned int pos = impl_socket_index_hash(
+                           instance.sockets[index].implementation_socket);
+
+    for (int i = 0; i < IMPL_SOCKET_INDEX_SIZE; i++)
+    {
+        if (implSocketIndex[pos] == IMPL_SOCKET_INDEX_EMPTY)
+        {
+            break;
+        }
+        if (implSocketIndex[pos] == index)
+        {
+            implSocketIndex[pos] = IMPL_SOCKET_INDEX_DELETED;
+            implSocketIndexDeleted++;
+            return;
+        }
+        pos = (pos + 1) % IMPL_SOCKET_INDEX_SIZE;
+    }
+
+    Debug_LOG_ERROR("Index %d not found in socket index", index);
+}
+
+//------------------------------------------------------------------------------
+// rebuild the reverse index to get rid of deleted slots, which otherwise make
+// lookups for unknown sockets degrade to a full table scan. The caller must
+// hold the socket control block mutex and the thread safety mutex, as entries
+// get moved.
+static void
+impl_socket_index_rebuild(void)
+{
+    for (int i = 0; i < IMPL_SOCKET_INDEX_SIZE; i++)
+    {
+        implSocketIndex[i] = IMPL_SOCKET_INDEX_EMPTY;
+    }
+    implSocketIndexDeleted = 0;
+
+    for (int i = 0; i < instance.number_of_sockets; i++)
+    {
+        if (instance.sockets[i].status == SOCKET_IN_USE)
+        {
+            impl_socket_index_insert(i);
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 // get implementation socket from a given handle
 void*
 get_implementation_socket_from_handle(
     const int handle)
 {
-    if (handle < 0 || handle >= instance.number_of_sockets)
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
     {
         Debug_LOG_ERROR("Trying to use invalid handle");
         return NULL;
     }
-    return instance.sockets[handle].implementation_socket;
+    return instance.sockets[index].implementation_socket;
 }
 
 //------------------------------------------------------------------------------
@@ -421,12 +893,13 @@ void*
 get_socket_from_handle(
     const int handle)
 {
-    if (handle < 0 || handle >= instance.number_of_sockets)
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
     {
         Debug_LOG_ERROR("Trying to use invalid handle");
         return NULL;
     }
-    return &instance.sockets[handle];
+    return &instance.sockets[index];
 }
 
 //------------------------------------------------------------------------------
@@ -435,14 +908,24 @@ int
 get_handle_from_implementation_socket(
     void* impl_sock)
 {
-    int handle = -1;
-    for (int i = 0; i < instance.number_of_sockets; i++)
-        if (instance.sockets[i].implementation_socket == impl_sock)
+    unsigned int pos = impl_socket_index_hash(impl_sock);
+
+    for (int i = 0; i < IMPL_SOCKET_INDEX_SIZE; i++)
+    {
+        const int index = implSocketIndex[pos];
+        if (index == IMPL_SOCKET_INDEX_EMPTY)
         {
-            handle = i;
             break;
         }
-    return handle;
+        if ((index >= 0)
+            && (instance.sockets[index].implementation_socket == impl_sock))
+        {
+            return socket_handle_from_index(index);
+        }
+        pos = (pos + 1) % IMPL_SOCKET_INDEX_SIZE;
+    }
+
+    return -1;
 }
 
 //------------------------------------------------------------------------------
@@ -528,21 +1011,35 @@ reserve_handle(
 
     int handle = -1;
 
-    for (int i = 0; i < instance.number_of_sockets; i++)
+    const int index = instance.free_sockets_head;
+    if (index >= 0)
     {
-        if (instance.sockets[i].status == SOCKET_FREE)
+        NetworkStack_SocketResources_t* const socket = &instance.sockets[index];
+
+        instance.free_sockets_head = socket->nextFree;
+
+        socket->status = SOCKET_IN_USE;
+        socket->implementation_socket = impl_sock;
+        socket->parentHandle = -1;
+        socket->current_error = OS_SUCCESS;
+        socket->clientId = clientId;
+        socket->pendingConnections = 0;
+        socket->socketType = 0;
+        socket->connected = false;
+        socket->nextFree = -1;
+        NetworkStack_STATS_SET(socket->bytesIn, 0);
+        NetworkStack_STATS_SET(socket->bytesOut, 0);
+
+        // This is called from the RPC thread with the thread safety mutex
+        // held, so no lookups from the stack tick can run in parallel.
+        if (implSocketIndexDeleted > instance.number_of_sockets / 2)
         {
-            instance.sockets[i].status = SOCKET_IN_USE;
-            instance.sockets[i].implementation_socket = impl_sock;
-            instance.sockets[i].parentHandle = -1;
-            instance.sockets[i].current_error = OS_SUCCESS;
-            instance.sockets[i].clientId = clientId;
-            instance.sockets[i].pendingConnections = 0;
-            instance.sockets[i].socketType = 0;
-            instance.sockets[i].connected = false;
-            handle = i;
-            break;
+            impl_socket_index_rebuild();
         }
+        impl_socket_index_insert(index);
+
+        handle = socket_handle_from_index(index);
+        instance.clients[clientIndex].currentSocketsInUse++;
     }
     internal_socket_control_block_mutex_unlock();
 
@@ -553,7 +1050,6 @@ reserve_handle(
     else
     {
         Debug_LOG_DEBUG("Reserved socket handle %d", handle);
-        instance.clients[clientIndex].currentSocketsInUse++;
     }
 
     return handle;
@@ -566,12 +1062,6 @@ free_handle(
     const int handle,
     const int clientId)
 {
-    if (handle < 0 || handle >= instance.number_of_sockets)
-    {
-        Debug_LOG_ERROR("Trying to free invalid handle");
-        return;
-    }
-
     const int clientIndex = get_client_index_from_clientId(clientId);
     if (clientIndex < 0)
     {
@@ -585,30 +1075,131 @@ free_handle(
         return;
     }
 
-    if (instance.sockets[handle].clientId != clientId)
+    // The handle is checked with the mutex held, so of two concurrent frees of
+    // the same handle only the first one finds the generation matching.
+    internal_socket_control_block_mutex_lock();
+
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
     {
-        Debug_LOG_ERROR("Trying to free handle that does not belong to client");
+        internal_socket_control_block_mutex_unlock();
+        Debug_LOG_ERROR("Trying to free invalid handle");
         return;
     }
 
-    internal_socket_control_block_mutex_lock();
+    NetworkStack_SocketResources_t* const socket = &instance.sockets[index];
+
+    if ((socket->status != SOCKET_IN_USE) || (socket->clientId != clientId))
+    {
+        internal_socket_control_block_mutex_unlock();
+        Debug_LOG_ERROR("Trying to free handle that does not belong to client");
+        return;
+    }
 
     instance.clients[clientIndex].currentSocketsInUse--;
 
-    instance.sockets[handle].status = SOCKET_FREE;
-    instance.sockets[handle].implementation_socket = NULL;
-    instance.sockets[handle].parentHandle = -1;
-    instance.sockets[handle].clientId = -1;
-    instance.sockets[handle].pendingConnections = 0;
-    instance.sockets[handle].eventMask = 0;
-    instance.sockets[handle].current_error = 0;
-    instance.sockets[handle].socketType = 0;
-    instance.sockets[handle].connected = false;
+    impl_socket_index_remove(index);
+
+    if (socket->inReadyList)
+    {
+        ready_list_remove(&instance.clients[clientIndex], index);
+    }
+
+    socket->status = SOCKET_FREE;
+    socket->implementation_socket = NULL;
+    socket->parentHandle = -1;
+    socket->clientId = -1;
+    socket->pendingConnections = 0;
+    __atomic_store_n(&socket->eventMask, 0, __ATOMIC_RELAXED);
+    socket->current_error = 0;
+    socket->socketType = 0;
+    socket->connected = false;
+
+    // Invalidate all handles that still refer to this slot and put it back
+    // on the free list.
+    socket->generation = (socket->generation + 1)
+                         & SOCKET_HANDLE_GENERATION_MASK;
+    socket->nextFree = instance.free_sockets_head;
+    instance.free_sockets_head = index;
     internal_socket_control_block_mutex_unlock();
 
     Debug_LOG_DEBUG("Freed socket handle %d", handle);
 }
 
+//------------------------------------------------------------------------------
+// queue a socket with pending events in the ready list of its client
+void
+mark_socket_ready(
+    const int handle)
+{
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
+    {
+        Debug_LOG_ERROR("mark_socket_ready: Invalid handle");
+        return;
+    }
+
+    internal_socket_control_block_mutex_lock();
+
+    NetworkStack_SocketResources_t* const socket = &instance.sockets[index];
+
+    if ((socket->status == SOCKET_IN_USE) && !socket->inReadyList)
+    {
+        const int clientIndex = get_client_index_from_clientId(
+                                    socket->clientId);
+        if (clientIndex >= 0)
+        {
+            ready_list_append(&instance.clients[clientIndex], index);
+        }
+    }
+
+    internal_socket_control_block_mutex_unlock();
+}
+
+//------------------------------------------------------------------------------
+// clear events of a socket, once no event is left the socket is taken off the
+// ready list, so its client is not reminded of it any more
+void
+clear_socket_events(
+    NetworkStack_SocketResources_t* const socket,
+    const uint16_t                         events)
+{
+    const uint16_t eventMask = NetworkStack_EVENTS_CLEAR(socket, events);
+
+    // Only the socket control block mutex adds a socket to the ready list. An
+    // event set meanwhile keeps the socket there, see the check below.
+    if ((eventMask & ~events)
+        || !__atomic_load_n(&socket->inReadyList, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    internal_socket_control_block_mutex_lock();
+
+    if (socket->inReadyList && (0 == NetworkStack_EVENTS_GET(socket)))
+    {
+        const int clientIndex = get_client_index_from_clientId(
+                                    socket->clientId);
+        if (clientIndex >= 0)
+        {
+            ready_list_remove(&instance.clients[clientIndex],
+                              socket - instance.sockets);
+        }
+    }
+
+    internal_socket_control_block_mutex_unlock();
+}
+
+//------------------------------------------------------------------------------
+// notify the client in the next notification pass, it may be held back then
+void
+request_client_notification(
+    NetworkStack_Client_t* const client)
+{
+    __atomic_store_n(&client->needsToBeNotified, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&instance.isNotifyPassNeeded, true, __ATOMIC_RELEASE);
+}
+
 //------------------------------------------------------------------------------
 // assign an accepted handle to its listening parent socket
 void
@@ -616,19 +1207,21 @@ set_parent_handle(
     const int handle,
     const int parentHandle)
 {
-    if (handle < 0 || handle >= instance.number_of_sockets)
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
     {
         Debug_LOG_ERROR("set_parent_handle: Invalid handle");
         return;
     }
-    if (parentHandle < 0 || parentHandle >= instance.number_of_sockets)
+    const int parentIndex = socket_index_from_handle(parentHandle);
+    if (parentIndex < 0)
     {
         Debug_LOG_ERROR("set_parent_handle: Invalid parent handle");
         return;
     }
     internal_socket_control_block_mutex_lock();
-    instance.sockets[handle].parentHandle = parentHandle;
-    instance.sockets[handle].clientId = instance.sockets[parentHandle].clientId;
+    instance.sockets[index].parentHandle = parentHandle;
+    instance.sockets[index].clientId = instance.sockets[parentIndex].clientId;
     internal_socket_control_block_mutex_unlock();
 }
 
@@ -638,59 +1231,233 @@ const OS_Dataport_t*
 get_dataport_for_handle(
     const int handle)
 {
-    if (handle < 0 || handle >= instance.number_of_sockets)
+    const int index = socket_index_from_handle(handle);
+    if (index < 0)
     {
         Debug_LOG_ERROR("get_dataport_for_handle: Invalid handle");
         return NULL;
     }
-    return &(instance.sockets[handle].buf);
+    return &(instance.sockets[index].buf);
 }
 
 //------------------------------------------------------------------------------
-// notify any client that has pending socket events
-static void
+// Returns true if a client with pending events is to be notified now,
+// otherwise sets the time in ms until it is due
+static bool
+client_notification_is_due(
+    NetworkStack_Client_t* const client,
+    int64_t* const               pWaitMs)
+{
+    // latency critical clients are notified right away
+    if (0 == client->notifyHoldoffUs)
+    {
+        return true;
+    }
+
+    if ((client->notifyEventThreshold > 0)
+        && (client->eventsSinceNotify >= client->notifyEventThreshold))
+    {
+        return true;
+    }
+
+    // The clock of the last stack tick is good enough here, the holdoff has
+    // the resolution of the loop wakeups in ms anyway.
+    const uint64_t now = clock_snapshot_get();
+    if (!client->isHoldoffRunning)
+    {
+        client->isHoldoffRunning = true;
+        client->holdoffStartMs   = now;
+    }
+
+    const uint64_t elapsedUs = (now - client->holdoffStartMs) * 1000;
+    if (elapsedUs >= client->notifyHoldoffUs)
+    {
+        return true;
+    }
+
+    *pWaitMs = (client->notifyHoldoffUs - elapsedUs + 999) / 1000;
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+// notify any client that has pending socket events, returns the time in ms
+// until a held back notification is due or -1 if there is none
+static int64_t
 notify_clients_about_pending_events(
     void)
 {
+    int64_t nextMs = -1;
+    bool isAnyLeft = false;
+
+    // Events raised from here on need another pass. A client with old pending
+    // events is reminded in every pass, as it was before.
+    __atomic_store_n(&instance.isNotifyPassNeeded, false, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
     // loop through all clients
     for (int i = 0; i < instance.number_of_clients; i++)
     {
-        if (instance.clients[i].inUse)
+        NetworkStack_Client_t* const client = &instance.clients[i];
+
+        if (client->inUse)
         {
             // check for sockets with old pending events
-            if (!instance.clients[i].needsToBeNotified)
+            if (client->readyCount > 0)
             {
-                for (int j = 0; j < instance.number_of_sockets; j++)
+                __atomic_store_n(&client->needsToBeNotified, true,
+                                 __ATOMIC_RELAXED);
+                isAnyLeft = true;
+            }
+
+            if (!__atomic_load_n(&client->needsToBeNotified, __ATOMIC_RELAXED))
+            {
+                continue;
+            }
+
+            int64_t waitMs;
+            if (!client_notification_is_due(client, &waitMs))
+            {
+                if ((nextMs < 0) || (waitMs < nextMs))
                 {
-                    if ((instance.sockets[j].status == SOCKET_IN_USE)
-                        && (instance.sockets[j].eventMask != 0)
-                        && (instance.sockets[j].clientId == instance.clients[i].clientId))
-                    {
-                        instance.clients[i].needsToBeNotified = true;
-                    }
+                    nextMs = waitMs;
                 }
+                isAnyLeft = true;
+                continue;
             }
 
+            // Clear the request before notifying, so a request an RPC thread
+            // makes from here on is kept for the next pass instead of being
+            // overwritten.
+            __atomic_store_n(&client->needsToBeNotified, false,
+                             __ATOMIC_RELAXED);
+
             // send out notifications to all client with pending events
-            if (instance.clients[i].needsToBeNotified)
+            if (NULL != client->eventNotify)
             {
-                if (NULL != instance.clients[i].eventNotify)
-                {
-                    Debug_LOG_TRACE("Notify client %d, clientId: %d", i,
-                                    instance.clients[i].clientId);
-                    instance.clients[i].eventNotify();
-                }
-                else
-                {
-                    Debug_LOG_ERROR("Found empty function pointer. "
-                                    "Cannot signal Client %d", i);
-                }
-                instance.clients[i].needsToBeNotified = false;
+                Debug_LOG_TRACE("Notify client %d, clientId: %d", i,
+                                client->clientId);
+                client->eventNotify();
+                NetworkStack_STATS_ADD(client->notifications, 1);
+            }
+            else
+            {
+                Debug_LOG_ERROR("Found empty function pointer. "
+                                "Cannot signal Client %d", i);
             }
+            client->eventsSinceNotify = 0;
+            client->isHoldoffRunning  = false;
         }
     }
+
+    if (isAnyLeft)
+    {
+        __atomic_store_n(&instance.isNotifyPassNeeded, true, __ATOMIC_RELAXED);
+    }
+
+    return nextMs;
 }
 
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_getStatistics(
+    NetworkStack_PicoTcp_Statistics_t* const stats)
+{
+    CHECK_PTR_NOT_NULL(stats);
+
+    if (networkStack_getState() != RUNNING)
+    {
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    pico_nic_get_statistics(&stats->nic);
+    internal_get_loop_statistics(&stats->loop);
+    for (int i = 0; i < NetworkStack_PicoTcp_WAKE_REASONS; i++)
+    {
+        stats->loop.wakeReasons[i] =
+            NetworkStack_STATS_GET(instance.wakeReasons[i]);
+    }
+    stats->loop.notifyPassesSkipped =
+        NetworkStack_STATS_GET(instance.notifyPassesSkipped);
+    clock_get_statistics(&stats->clock);
+
+    // Nothing is locked here, so the values of different counters may be
+    // from slightly different points in time.
+    stats->numberOfClients = 0;
+    for (int i = 0; (i < instance.number_of_clients)
+         && (i < NetworkStack_PicoTcp_STATISTICS_MAX_CLIENTS); i++)
+    {
+        if (instance.clients[i].inUse)
+        {
+            NetworkStack_PicoTcp_ClientStatistics_t* const client =
+                &stats->clients[stats->numberOfClients++];
+
+            client->clientId = instance.clients[i].clientId;
+            client->notifications =
+                NetworkStack_STATS_GET(instance.clients[i].notifications);
+        }
+    }
+
+    // The socket table may be larger than the statistics, e.g. in a host build
+    // with more sockets. The first sockets in use are reported then.
+    stats->numberOfSockets = 0;
+    for (int i = 0; (i < instance.number_of_sockets)
+         && (stats->numberOfSockets
+             < NetworkStack_PicoTcp_STATISTICS_MAX_SOCKETS); i++)
+    {
+        if (instance.sockets[i].status == SOCKET_IN_USE)
+        {
+            NetworkStack_PicoTcp_SocketStatistics_t* const socket =
+                &stats->sockets[stats->numberOfSockets++];
+
+            socket->handle = socket_handle_from_index(i);
+            socket->clientId = instance.sockets[i].clientId;
+            socket->bytesIn = NetworkStack_STATS_GET(instance.sockets[i].bytesIn);
+            socket->bytesOut =
+                NetworkStack_STATS_GET(instance.sockets[i].bytesOut);
+        }
+    }
+
+    return OS_SUCCESS;
+}
+
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+
+//------------------------------------------------------------------------------
+OS_Error_t
+NetworkStack_getClientProfile(
+    const int                                   clientIndex,
+    NetworkStack_PicoTcp_ClientProfile_t* const profile)
+{
+    CHECK_PTR_NOT_NULL(profile);
+
+    if (networkStack_getState() != RUNNING)
+    {
+        return OS_ERROR_INVALID_STATE;
+    }
+
+    if ((clientIndex < 0) || (clientIndex >= instance.number_of_clients))
+    {
+        return OS_ERROR_OUT_OF_BOUNDS;
+    }
+
+    const NetworkStack_Client_t* const client = &instance.clients[clientIndex];
+    if (!client->inUse)
+    {
+        return OS_ERROR_NOT_FOUND;
+    }
+
+    profile->clientId = client->clientId;
+    for (int i = 0; i < NetworkStack_PicoTcp_RPCS; i++)
+    {
+        network_stack_profile_rpc_get(&profile->rpcs[i], &client->rpcs[i]);
+    }
+
+    return OS_SUCCESS;
+}
+
+#endif // NetworkStack_PicoTcp_USE_PROFILING
+
 //------------------------------------------------------------------------------
 OS_Error_t
 NetworkStack_init(
@@ -713,6 +1480,34 @@ NetworkStack_init(
         = camkes_config->internal.number_of_clients;
     instance.clients    = instance.camkes_cfg->internal.clients;
 
+    if (instance.number_of_sockets > NetworkStack_PicoTcp_MAX_SOCKETS)
+    {
+        Debug_LOG_ERROR("%s: %d sockets exceed the maximum of %d", __func__,
+                        instance.number_of_sockets,
+                        NetworkStack_PicoTcp_MAX_SOCKETS);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+
+#if defined(NetworkStack_PicoTcp_USE_COMMAND_QUEUE)
+    if ((NULL == camkes_config->internal.wait_command)
+        || (NULL == camkes_config->internal.notify_command))
+    {
+        Debug_LOG_ERROR("%s: the command queue requires wait_command and "
+                        "notify_command", __func__);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+#endif
+
+    // chain all slots into the free list
+    for (int i = 0; i < instance.number_of_sockets; i++)
+    {
+        instance.sockets[i].nextFree = (i + 1 < instance.number_of_sockets) ?
+                                       i + 1 : -1;
+    }
+    instance.free_sockets_head = (instance.number_of_sockets > 0) ? 0 : -1;
+
+    impl_socket_index_rebuild();
+
     NetworkStack_Interface_t network_stack = network_stack_pico_get_config();
 
     // initialize Network Stack and set API functions
@@ -729,6 +1524,31 @@ NetworkStack_init(
 }
 
 
+//------------------------------------------------------------------------------
+// count a loop iteration for each of its wake reasons, a wakeup without any
+// signaled reason came from the driver or the Ticker
+static void
+count_wake_reasons(
+    const uint32_t reasons,
+    const bool     isWaiting)
+{
+    if ((0 == reasons) && isWaiting)
+    {
+        NetworkStack_STATS_ADD(
+            instance.wakeReasons[NetworkStack_PicoTcp_WAKE_EXTERNAL], 1);
+        return;
+    }
+
+    for (int i = 0; i < NetworkStack_PicoTcp_WAKE_REASONS; i++)
+    {
+        if (reasons & (1U << i))
+        {
+            NetworkStack_STATS_ADD(instance.wakeReasons[i], 1);
+        }
+    }
+}
+
+
 //------------------------------------------------------------------------------
 // CAmkES run()
 OS_Error_t
@@ -746,13 +1566,76 @@ NetworkStack_run(void)
     for (;;)
     {
         // wait for event ( 1 sec tick, write, read)
-        wait_network_event();
+        // While the NIC is busy polled, run again right away instead of
+        // waiting for the driver to signal new frames.
+        const bool isWaiting = !pico_nic_is_busy_polling();
+        if (isWaiting)
+        {
+            NetworkStack_PROFILE_START(waitStart);
+            wait_network_event();
+            NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_WAIT,
+                                       waitStart);
+        }
+
+        // Everything signaled so far is processed below, so later requests
+        // must signal a new wakeup.
+        const uint32_t reasons = internal_take_main_loop_wake_reasons();
+        count_wake_reasons(reasons, isWaiting);
+
+        // socket RPCs queued for the stack thread, they lock the stack
+        // themselves and always signal a client wakeup
+        if (reasons & (1U << NetworkStack_PicoTcp_WAKE_CLIENT))
+        {
+            NetworkStack_PROFILE_START(commandsStart);
+            network_stack_command_run_pending();
+            NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_COMMANDS,
+                                       commandsStart);
+        }
 
         internal_network_stack_thread_safety_mutex_lock();
         // let stack process the event
-        network_stack.stack_tick();
-        notify_clients_about_pending_events();
+        NetworkStack_PROFILE_START(tickStart);
+        const int64_t next_timer_ms = network_stack.stack_tick();
+        NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_TICK, tickStart);
+
+        // Skip the notification pass if no client got new events and none is
+        // held back or has old pending events.
+        int64_t next_notify_ms = -1;
+        if (__atomic_load_n(&instance.isNotifyPassNeeded, __ATOMIC_ACQUIRE))
+        {
+            NetworkStack_PROFILE_START(notifyStart);
+            next_notify_ms = notify_clients_about_pending_events();
+            NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_NOTIFY,
+                                       notifyStart);
+        }
+        else
+        {
+            NetworkStack_STATS_ADD(instance.notifyPassesSkipped, 1);
+        }
         internal_network_stack_thread_safety_mutex_unlock();
+
+        // wake up for held back client notifications as well
+        int64_t next_wakeup_ms = next_timer_ms;
+        if ((next_notify_ms >= 0)
+            && ((next_wakeup_ms < 0) || (next_notify_ms < next_wakeup_ms)))
+        {
+            next_wakeup_ms = next_notify_ms;
+        }
+
+        // If the stack tells us when its next timer expires, wake up exactly
+        // then instead of relying on a periodic tick.
+        if (pico_nic_is_busy_polling())
+        {
+            // the loop does not wait, so there is nothing to schedule
+        }
+        else if (next_wakeup_ms == 0)
+        {
+            internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_TIMER);
+        }
+        else if (next_wakeup_ms > 0)
+        {
+            internal_schedule_main_loop(next_wakeup_ms);
+        }
     }
 
     Debug_LOG_WARNING("network_stack_event_loop() terminated gracefully");
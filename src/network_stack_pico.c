@@ -17,6 +17,7 @@
 #include "network_stack_core.h"
 #include "network_stack_pico.h"
 #include "network_stack_pico_nic.h"
+#include "network_stack_trace.h"
 #include "pico_device.h"
 #include "pico_icmp4.h"
 #include "pico_ipv4.h"
@@ -147,11 +148,50 @@ OS_Error_t nw_pico_stack_init(void) {
     return pico_stack_init(&pico_stack_ctx);
 }
 
-void nw_pico_stack_tick(void) {
+int64_t nw_pico_stack_tick(void) {
+    // picoTCP reads the clock many times during a tick, one reading is enough
+    clock_snapshot_take();
+    pico_nic_budget_start();
+#if defined(NetworkStack_PicoTcp_USE_TICKLESS)
+    // requires picoTCP to be built with PICO_SUPPORT_TICKLESS
+    long long int next_timer_ms = pico_stack_go(pico_stack_ctx);
+#else
     pico_stack_tick(pico_stack_ctx);
+    long long int next_timer_ms = -1;
+#endif
+    // hand over all frames picoTCP has sent during this tick to the driver
+    pico_nic_flush();
+    clock_snapshot_release();
+
+    return next_timer_ms;
 }
 
 
+//------------------------------------------------------------------------------
+// With the C flag NetworkStack_PicoTcp_USE_INLINE_TX, a write RPC lets picoTCP
+// send its data right away and hands the frames to the driver, instead of
+// waiting until the control thread woke up. picoTCP has no call to send the
+// output of one socket only, so this runs a stack tick, but with the NIC RX
+// poll switched off. The NIC RX queue, the busy poll state and the work budget
+// are left to the control thread. Expired picoTCP timers still run. The write
+// notifies the control thread afterwards, which schedules its next wakeup with
+// its own tick. With the command queue, the write already runs on the control
+// thread right before its tick, so nothing is done here. Caller must hold the
+// thread safety mutex.
+static void
+inline_transmit(void)
+{
+#if defined(NetworkStack_PicoTcp_USE_INLINE_TX) \
+    && !defined(NetworkStack_PicoTcp_USE_COMMAND_QUEUE)
+    clock_snapshot_take();
+    pico_nic_set_tx_only(true);
+    pico_stack_tick(pico_stack_ctx);
+    pico_nic_set_tx_only(false);
+    pico_nic_flush();
+    clock_snapshot_release();
+#endif
+}
+
 NetworkStack_Interface_t
 network_stack_pico_get_config(void)
 {
@@ -275,9 +315,6 @@ handle_pico_socket_event(
     Debug_LOG_TRACE("Event for handle %d/%p Value: 0x%x State %x",
                     handle, pico_socket, event_mask, TCPSTATE(pico_socket));
 
-    char srcAddr[IP_ADD_STR_MAX_LEN];
-    pico_ipv4_to_string(srcAddr, pico_socket->remote_addr.ip4.addr);
-
     if (event_mask & PICO_SOCK_EV_CONN)
     {
         Debug_LOG_TRACE("[socket %d/%p] PICO_SOCK_EV_CONN", handle, pico_socket);
@@ -285,20 +322,16 @@ handle_pico_socket_event(
         if (pico_socket->state & PICO_SOCKET_STATE_TCP_LISTEN)
         {
             // SYN has arrived
-            Debug_LOG_INFO("[socket %d/%p] received incoming connection request",
-                           handle,
-                           pico_socket);
-            socket->eventMask |= OS_SOCK_EV_CONN_ACPT;
+            NetworkStack_TRACE(NetworkStack_TRACE_CONN_REQUEST, handle, 0, 0);
+            NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_CONN_ACPT);
             socket->pendingConnections++;
         }
         else
         {
             // SYN-ACK has arrived
-            Debug_LOG_INFO("[socket %d/%p] connection established to %s",
-                           handle,
-                           pico_socket,
-                           srcAddr);
-            socket->eventMask |= OS_SOCK_EV_CONN_EST;
+            NetworkStack_TRACE(NetworkStack_TRACE_CONN_ESTABLISHED, handle,
+                               pico_socket->remote_addr.ip4.addr, 0);
+            NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_CONN_EST);
             socket->connected = true;
         }
     }
@@ -306,27 +339,27 @@ handle_pico_socket_event(
     if (event_mask & PICO_SOCK_EV_RD)
     {
         Debug_LOG_TRACE("[socket %d/%p] PICO_SOCK_EV_RD", handle, pico_socket);
-        socket->eventMask |= OS_SOCK_EV_READ;
+        NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_READ);
     }
 
     if (event_mask & PICO_SOCK_EV_WR)
     {
         Debug_LOG_TRACE("[socket %d/%p] PICO_SOCK_EV_WR", handle, pico_socket);
         // notify app, which is waiting to write
-        socket->eventMask |= OS_SOCK_EV_WRITE;
+        NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_WRITE);
     }
 
     if (event_mask & PICO_SOCK_EV_CLOSE)
     {
-        Debug_LOG_INFO("[socket %d/%p] connection closed by %s",
-                       handle, pico_socket, srcAddr);
-        socket->eventMask |= OS_SOCK_EV_CLOSE;
+        NetworkStack_TRACE(NetworkStack_TRACE_CONN_CLOSED, handle,
+                           pico_socket->remote_addr.ip4.addr, 0);
+        NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_CLOSE);
     }
 
     if (event_mask & PICO_SOCK_EV_FIN)
     {
         Debug_LOG_TRACE("[socket %d/%p] PICO_SOCK_EV_FIN", handle, pico_socket);
-        socket->eventMask |= OS_SOCK_EV_FIN;
+        NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_FIN);
         // If PICO_SOCK_EV_FIN is set by picoTCP, the implementation_socket will
         // be freed automatically and may not be accessed any more.
     }
@@ -340,7 +373,7 @@ handle_pico_socket_event(
                         pico_socket,
                         err,
                         Debug_OS_Error_toString(err));
-        socket->eventMask |= OS_SOCK_EV_ERROR;
+        NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_ERROR);
 
         // If err = PICO_ERR_ECONNREFUSED is set by picoTCP, the
         // implementation_socket will be freed automatically and may not be
@@ -350,14 +383,17 @@ handle_pico_socket_event(
         {
             Debug_LOG_DEBUG("[socket %d/%p] PICO_SOCK_EV_ERR & PICO_ERR_ECONNREFUSED",
                             handle, pico_socket);
-            socket->eventMask |= OS_SOCK_EV_FIN;
+            NetworkStack_EVENTS_SET(socket, OS_SOCK_EV_FIN);
         }
     }
 
+    mark_socket_ready(handle);
+
     NetworkStack_Client_t* client = get_client_from_clientId(
                                         socket->clientId);
 
-    client->needsToBeNotified = true;
+    request_client_notification(client);
+    client->eventsSinceNotify++;
 }
 
 //------------------------------------------------------------------------------
@@ -416,7 +452,7 @@ network_stack_pico_socket_create(
             cur_pico_err = pico_err;
         }
 
-        internal_notify_main_loop();
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
         if (PICO_ERR_NOERR != cur_pico_err)
         {
@@ -441,7 +477,8 @@ network_stack_pico_socket_create(
     socket->current_error = pico_err2os(cur_pico_err);
     *pHandle              = handle;
 
-    Debug_LOG_INFO("[socket %d/%p] socket opened", handle, pico_socket);
+    NetworkStack_TRACE(NetworkStack_TRACE_SOCKET_OPENED, handle, socket_type,
+                       0);
 
     helper_socket_set_option_int(
         pico_socket,
@@ -479,7 +516,7 @@ network_stack_pico_socket_close(
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
     struct pico_socket* pico_socket = socket->implementation_socket;
 
-    if (!(socket->eventMask & OS_SOCK_EV_FIN))
+    if (!(NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN))
     {
         CHECK_SOCKET(pico_socket, handle);
 
@@ -487,10 +524,10 @@ network_stack_pico_socket_close(
         int ret = pico_socket_close(pico_socket);
         OS_Error_t err =  pico_err2os(pico_err);
         socket->current_error = err;
-        socket->eventMask     &= ~(OS_SOCK_EV_CLOSE);
+        clear_socket_events(socket, OS_SOCK_EV_CLOSE);
         internal_network_stack_thread_safety_mutex_unlock();
 
-        internal_notify_main_loop();
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
         if (ret < 0)
         {
@@ -504,7 +541,7 @@ network_stack_pico_socket_close(
 
     free_handle(handle, clientId);
 
-    Debug_LOG_INFO("[socket %d/%p] socket closed", handle, pico_socket);
+    NetworkStack_TRACE(NetworkStack_TRACE_SOCKET_CLOSED, handle, 0, 0);
 
     return OS_SUCCESS;
 }
@@ -518,7 +555,7 @@ network_stack_pico_socket_connect(
     int ret;
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -554,7 +591,7 @@ network_stack_pico_socket_connect(
         return err;
     }
 
-    internal_notify_main_loop();
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
     return OS_SUCCESS;
 }
@@ -568,7 +605,7 @@ network_stack_pico_socket_bind(
     int ret;
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -606,7 +643,7 @@ network_stack_pico_socket_bind(
         return err;
     }
 
-    internal_notify_main_loop();
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
     return OS_SUCCESS;
 }
@@ -619,7 +656,7 @@ network_stack_pico_socket_listen(
 {
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -641,34 +678,26 @@ network_stack_pico_socket_listen(
         return err;
     }
 
-    internal_notify_main_loop();
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
     return OS_SUCCESS;
 }
 
 //------------------------------------------------------------------------------
-OS_Error_t
-network_stack_pico_socket_accept(
-    const int               handle,
-    int* const              pClient_handle,
-    OS_Socket_Addr_t* const srcAddr)
+// Accepts one pending connection of a listening socket, caller must hold the
+// thread safety mutex
+static OS_Error_t
+socket_accept_locked(
+    const int                             handle,
+    NetworkStack_SocketResources_t* const socket,
+    int* const                            pClient_handle,
+    OS_Socket_Addr_t* const               srcAddr)
 {
     uint16_t        port = 0;
     struct pico_ip4 orig = { 0 };
 
-    NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
-
-    if (socket->eventMask & OS_SOCK_EV_FIN)
-    {
-        return OS_ERROR_CONNECTION_CLOSED;
-    }
-
     struct pico_socket* pico_socket = socket->implementation_socket;
 
-    CHECK_SOCKET(pico_socket, handle);
-
-    internal_network_stack_thread_safety_mutex_lock();
-
     struct pico_socket* s_in = pico_socket_accept(pico_socket, &orig, &port);
     OS_Error_t          err  = pico_err2os(pico_err);
     socket->current_error    = err;
@@ -679,7 +708,7 @@ network_stack_pico_socket_accept(
 
     if (socket->pendingConnections == 0)
     {
-        socket->eventMask &= ~OS_SOCK_EV_CONN_ACPT;
+        clear_socket_events(socket, OS_SOCK_EV_CONN_ACPT);
     }
 
     if (NULL == s_in)
@@ -692,8 +721,7 @@ network_stack_pico_socket_accept(
                 err,
                 Debug_OS_Error_toString(err));
         }
-        internal_notify_main_loop();
-        internal_network_stack_thread_safety_mutex_unlock();
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
         return err;
     }
 
@@ -701,7 +729,6 @@ network_stack_pico_socket_accept(
     if (accepted_handle == -1)
     {
         pico_socket_close(s_in);
-        internal_network_stack_thread_safety_mutex_unlock();
         return OS_ERROR_INSUFFICIENT_SPACE;
     }
 
@@ -735,15 +762,8 @@ network_stack_pico_socket_accept(
 
     *pClient_handle = accepted_handle;
 
-    char acptAddr[IP_ADD_STR_MAX_LEN];
-    pico_ipv4_to_string(acptAddr, orig.addr);
-
-    Debug_LOG_INFO(
-        "[socket %d/%p] accepted incoming connection from %s:%d",
-        accepted_handle,
-        get_implementation_socket_from_handle(accepted_handle),
-        acptAddr,
-        port);
+    NetworkStack_TRACE(NetworkStack_TRACE_CONN_ACCEPTED, accepted_handle,
+                       orig.addr, short_be(port));
 
     DECL_UNUSED_VAR(struct pico_socket * client_socket) =
         get_implementation_socket_from_handle(
@@ -756,18 +776,115 @@ network_stack_pico_socket_accept(
 
     socket_client = get_socket_from_handle(*pClient_handle);
 
-    CHECK_CLIENT_ID(socket_client);
+    // The caller was checked to own the listening socket, the accepted one
+    // was reserved for the same client. This may run on the stack thread, so
+    // do not ask for the client of the current RPC here.
+    Debug_ASSERT(socket_client->clientId == socket->clientId);
 
     socket_client->socketType = OS_SOCK_STREAM;
     socket_client->connected  = true;
 
     socket_client->buf_io = socket->buf_io;
     socket_client->buf    = socket->buf;
-    internal_network_stack_thread_safety_mutex_unlock();
+
+    pico_ipv4_to_string((char*)srcAddr->addr, orig.addr);
+    srcAddr->port = short_be(port);
 
     return OS_SUCCESS;
 }
 
+//------------------------------------------------------------------------------
+OS_Error_t
+network_stack_pico_socket_accept(
+    const int               handle,
+    int* const              pClient_handle,
+    OS_Socket_Addr_t* const srcAddr)
+{
+    NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
+
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
+    {
+        return OS_ERROR_CONNECTION_CLOSED;
+    }
+
+    CHECK_SOCKET(socket->implementation_socket, handle);
+
+    internal_network_stack_thread_safety_mutex_lock();
+    OS_Error_t err = socket_accept_locked(handle, socket, pClient_handle,
+                                          srcAddr);
+    internal_network_stack_thread_safety_mutex_unlock();
+
+    return err;
+}
+
+//------------------------------------------------------------------------------
+OS_Error_t
+network_stack_pico_socket_acceptMany(
+    const int                                  handle,
+    const int                                  max,
+    NetworkStack_PicoTcp_AcceptRecord_t* const records,
+    int* const                                 pAccepted)
+{
+    NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
+
+    *pAccepted = 0;
+
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
+    {
+        return OS_ERROR_CONNECTION_CLOSED;
+    }
+
+    CHECK_SOCKET(socket->implementation_socket, handle);
+
+    const NetworkStack_Client_t* const client =
+        get_client_from_clientId(socket->clientId);
+    if (NULL == client)
+    {
+        return OS_ERROR_ABORTED;
+    }
+
+    // all connections are accepted with one lock of the stack, until none is
+    // pending any more
+    OS_Error_t err = OS_SUCCESS;
+    int accepted = 0;
+
+    internal_network_stack_thread_safety_mutex_lock();
+
+    // Accept only as many connections as the client has sockets left, so
+    // picoTCP never hands out one that reserve_handle() rejects and closes.
+    // The others stay pending for a later call.
+    const int socketsLeft = client->socketQuota - client->currentSocketsInUse;
+    const int limit = (max < socketsLeft) ? max : socketsLeft;
+    if (limit <= 0)
+    {
+        internal_network_stack_thread_safety_mutex_unlock();
+        Debug_LOG_ERROR("No free sockets available for client %d",
+                        socket->clientId);
+        return OS_ERROR_INSUFFICIENT_SPACE;
+    }
+
+    while (accepted < limit)
+    {
+        int clientHandle;
+        err = socket_accept_locked(handle, socket, &clientHandle,
+                                   &records[accepted].srcAddr);
+        if (err != OS_SUCCESS)
+        {
+            break;
+        }
+        records[accepted].handle = clientHandle;
+        accepted++;
+    }
+    internal_network_stack_thread_safety_mutex_unlock();
+
+    *pAccepted = accepted;
+
+    // An error after the first connection ends the batch and is dropped, the
+    // accepted connections are reported instead. If the error persists, the
+    // next call fails with it on its first connection.
+    return (accepted > 0) ? OS_SUCCESS : err;
+}
+
 //------------------------------------------------------------------------------
 OS_Error_t
 network_stack_pico_socket_write(
@@ -776,7 +893,7 @@ network_stack_pico_socket_write(
 {
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -796,6 +913,10 @@ network_stack_pico_socket_write(
                                 len);
     OS_Error_t err = pico_err2os(pico_err);
     socket->current_error = err;
+    if (ret > 0)
+    {
+        inline_transmit();
+    }
     internal_network_stack_thread_safety_mutex_unlock();
 
     if (ret < 0)
@@ -808,8 +929,9 @@ network_stack_pico_socket_write(
     }
 
     *pLen = ret;
+    NetworkStack_STATS_ADD(socket->bytesOut, ret);
 
-    internal_notify_main_loop();
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
     return OS_SUCCESS;
 }
@@ -822,7 +944,7 @@ network_stack_pico_socket_read(
 {
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -859,7 +981,7 @@ network_stack_pico_socket_read(
                             Debug_OS_Error_toString(err));
         }
 
-        socket->eventMask &= ~OS_SOCK_EV_READ;
+        clear_socket_events(socket, OS_SOCK_EV_READ);
 
         *pLen = 0;
 
@@ -869,10 +991,10 @@ network_stack_pico_socket_read(
     // No further data available in the queue.
     else if (ret == 0)
     {
-        socket->eventMask &= ~OS_SOCK_EV_READ;
+        clear_socket_events(socket, OS_SOCK_EV_READ);
         *pLen = ret;
 
-        internal_notify_main_loop();
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
         return OS_ERROR_TRY_AGAIN;
     }
@@ -892,9 +1014,10 @@ network_stack_pico_socket_read(
 #endif
         if (len > ret)
         {
-            socket->eventMask &= ~OS_SOCK_EV_READ;
+            clear_socket_events(socket, OS_SOCK_EV_READ);
         }
         *pLen = ret;
+        NetworkStack_STATS_ADD(socket->bytesIn, ret);
     }
 
     return OS_SUCCESS;
@@ -910,7 +1033,7 @@ network_stack_pico_socket_sendto(
     int ret;
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -942,6 +1065,10 @@ network_stack_pico_socket_sendto(
             short_be(dstAddr->port));
     OS_Error_t err = pico_err2os(pico_err);
     socket->current_error = err;
+    if (ret > 0)
+    {
+        inline_transmit();
+    }
     internal_network_stack_thread_safety_mutex_unlock();
 
     if (ret < 0)
@@ -959,8 +1086,9 @@ network_stack_pico_socket_sendto(
     }
 
     *pLen = ret;
+    NetworkStack_STATS_ADD(socket->bytesOut, ret);
 
-    internal_notify_main_loop();
+    internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
     return OS_SUCCESS;
 }
@@ -974,7 +1102,7 @@ network_stack_pico_socket_recvfrom(
 {
     NetworkStack_SocketResources_t* socket = get_socket_from_handle(handle);
 
-    if (socket->eventMask & OS_SOCK_EV_FIN)
+    if (NetworkStack_EVENTS_GET(socket) & OS_SOCK_EV_FIN)
     {
         return OS_ERROR_CONNECTION_CLOSED;
     }
@@ -1008,7 +1136,7 @@ network_stack_pico_socket_recvfrom(
             "translating to OS error %d (%s)", handle, pico_socket, ret, err,
             Debug_OS_Error_toString(err));
 
-        socket->eventMask &= ~OS_SOCK_EV_READ;
+        clear_socket_events(socket, OS_SOCK_EV_READ);
         *pLen = 0;
 
         return err;
@@ -1019,10 +1147,10 @@ network_stack_pico_socket_recvfrom(
         // number are unchanged, meaning there is no further data in the queue.
         if ((ret == 0) && (src.addr == 0) && (sport == 0))
         {
-            socket->eventMask &= ~OS_SOCK_EV_READ;
+            clear_socket_events(socket, OS_SOCK_EV_READ);
             *pLen = ret;
 
-            internal_notify_main_loop();
+            internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_CLIENT);
 
             return OS_ERROR_TRY_AGAIN;
         }
@@ -1044,6 +1172,7 @@ network_stack_pico_socket_recvfrom(
                 len);
 #endif
             *pLen = ret;
+            NetworkStack_STATS_ADD(socket->bytesIn, ret);
 
             // If srcAddr is NULL it means the user doesn't want the
             // sender's information.
@@ -12,16 +12,292 @@
 #include "network/OS_NetworkStackTypes.h"
 #include "network/OS_SocketTypes.h"
 
+#include "if_NetworkStack_PicoTcp_NicBatch.h"
 #include "network_stack_config.h"
+#include "network_stack_core.h"
+#include "network_stack_pico_nic.h"
+#include "network_stack_profile.h"
 #include "pico_device.h"
 #include "pico_stack.h"
 
+#include <inttypes.h>
 #include <stddef.h>
 #include <stdlib.h>
 
 // currently we support only one NIC
 static struct pico_device os_nic;
 
+// Written by the stack tick with the thread safety mutex held, usually on the
+// control thread, with NetworkStack_PicoTcp_USE_INLINE_TX also on an RPC
+// thread. See NetworkStack_STATS_ADD().
+static NetworkStack_PicoTcp_NicStatistics_t nicStats;
+
+#if defined(NetworkStack_PicoTcp_USE_BUSY_POLL)
+// Written by the stack tick of the control thread with the thread safety mutex
+// held, inline TX ticks leave it alone. The control thread reads isActive
+// without the mutex to decide if it waits.
+static struct
+{
+    bool         isActive;
+    unsigned int loadedPolls; // consecutive polls with load
+    uint64_t     deadlineMs;  // fall back to events if no frame came until then
+} busyPoll;
+#endif
+
+// set by pico_nic_set_tx_only(), only used with the thread safety mutex held
+static bool isTxOnlyTick = false;
+
+// Work budget of the current stack tick, see
+// NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES. Only used with the thread safety
+// mutex held.
+static struct
+{
+    unsigned int frames;      // received and sent in this tick
+    uint64_t     startTicks;  // timestamp at the start of the tick
+    uint64_t     limitTicks;  // time budget in timestamp ticks, 0 if unknown
+    bool         isExhausted;
+
+    // calibration of the timestamp counter against the clock in ms
+    bool         isCalibrated;
+    uint64_t     calibrationStartMs;
+    uint64_t     calibrationStartTicks;
+} budget;
+
+// Frames from the legacy RX ring are processed by picoTCP in place, the ring
+// slot is handed back to the driver when picoTCP frees the frame. As the driver
+// fills the slots in ring order, a slot held for long blocks all reception
+// once the ring wraps around to it. So only frames that picoTCP frees by
+// itself are held, see nic_rx_frame_is_transient(), and at most half of the
+// ring at any time. All other frames are copied.
+static struct
+{
+    OS_NetworkStack_RxBuffer_t* ring;
+    bool*    isHeld;
+    size_t   size;
+    size_t   held;
+} rxRing;
+
+// Ethernet and IPv4 header fields checked by nic_rx_frame_is_transient()
+#define ETH_HEADER_LEN          14
+#define ETH_TYPE_OFFSET         12
+#define ETH_TYPE_IPV4           0x0800
+#define IPV4_HEADER_MIN_LEN     20
+#define IPV4_FRAG_OFFSET        6
+#define IPV4_FRAG_MASK          0x3fff // more fragments flag and offset
+#define IPV4_PROTO_OFFSET       9
+#define IPV4_PROTO_TCP          6
+
+// Frames sent by picoTCP are collected in the outgoing dataport and handed
+// over to the driver all at once at the end of the stack tick, or earlier if
+// the dataport is full.
+static struct
+{
+    bool   isEnabled;
+    size_t frames;
+    size_t used; // bytes in use, including the descriptor table
+} txBatch;
+
+//------------------------------------------------------------------------------
+// Account a frame passed to pico_stack_recv(), which returned ret
+static void
+nic_stats_rx(
+    int    ret,
+    size_t len)
+{
+    if (ret > 0)
+    {
+        NetworkStack_STATS_ADD(nicStats.rxFrames, 1);
+        NetworkStack_STATS_ADD(nicStats.rxBytes, len);
+    }
+    else
+    {
+        NetworkStack_STATS_ADD(nicStats.rxDropped, 1);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Converts the time budget into timestamp ticks, once the counter has run for
+// the calibration period
+static void
+nic_budget_calibrate(
+    uint64_t nowMs,
+    uint64_t nowTicks)
+{
+    if (0 == budget.calibrationStartMs)
+    {
+        budget.calibrationStartMs    = nowMs;
+        budget.calibrationStartTicks = nowTicks;
+        return;
+    }
+
+    const uint64_t elapsedMs = nowMs - budget.calibrationStartMs;
+    if (elapsedMs < NetworkStack_PicoTcp_LOOP_BUDGET_CALIBRATION_MS)
+    {
+        return;
+    }
+
+    const uint64_t ticksPerMs =
+        (nowTicks - budget.calibrationStartTicks) / elapsedMs;
+
+    budget.isCalibrated = true;
+    budget.limitTicks = ticksPerMs * NetworkStack_PicoTcp_LOOP_BUDGET_US / 1000;
+    if (0 == budget.limitTicks)
+    {
+        Debug_LOG_WARNING("No timestamp counter, loop time budget disabled");
+        return;
+    }
+
+    Debug_LOG_INFO("Loop time budget of %u us is %" PRIu64 " ticks",
+                   NetworkStack_PicoTcp_LOOP_BUDGET_US, budget.limitTicks);
+}
+
+//------------------------------------------------------------------------------
+// Returns false once the budget of the current tick is exhausted, the frames
+// processed are added to budget.frames by the caller
+static bool
+nic_budget_is_left(void)
+{
+    if (budget.isExhausted)
+    {
+        return false;
+    }
+
+    const bool isFramesExhausted =
+        (NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES > 0)
+        && (budget.frames >= NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES);
+    const bool isTimeExhausted =
+        (budget.limitTicks > 0)
+        && ((internal_get_timestamp() - budget.startTicks)
+            >= budget.limitTicks);
+
+    if (isFramesExhausted || isTimeExhausted)
+    {
+        Debug_LOG_TRACE("Loop budget exhausted after %u frames",
+                        budget.frames);
+        budget.isExhausted = true;
+        NetworkStack_STATS_ADD(nicStats.budgetExhausted, 1);
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Returns how many of maxFrames the budget of the current tick still permits
+static size_t
+nic_budget_frames_left(
+    size_t maxFrames)
+{
+    if (!nic_budget_is_left())
+    {
+        return 0;
+    }
+
+    // is_left() made sure that frames is below the budget
+    if (NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES > 0)
+    {
+        const size_t left = NetworkStack_PicoTcp_LOOP_BUDGET_FRAMES
+                            - budget.frames;
+        if (left < maxFrames)
+        {
+            return left;
+        }
+    }
+
+    return maxFrames;
+}
+
+//------------------------------------------------------------------------------
+// Hand over all frames collected in the outgoing dataport to the driver
+static OS_Error_t
+nic_tx_batch_flush(void)
+{
+    if (0 == txBatch.frames)
+    {
+        return OS_SUCCESS;
+    }
+
+    OS_Error_t err = nic_dev_write_batch(txBatch.frames);
+    if (OS_ERROR_TRY_AGAIN == err)
+    {
+        // keep the frames, the driver has not taken over any of them
+        Debug_LOG_WARNING("Send batch couldn't complete. Retrying");
+        NetworkStack_STATS_ADD(nicStats.txRetries, 1);
+        return err;
+    }
+
+    if (OS_ERROR_NOT_IMPLEMENTED == err)
+    {
+        // the probe at initialization could not tell, send single frames
+        // from now on
+        Debug_LOG_WARNING("Batched TX not supported, disabling it");
+        txBatch.isEnabled = false;
+    }
+
+    if (OS_SUCCESS != err)
+    {
+        Debug_LOG_ERROR("nic_dev_write_batch() failed, dropping %zu frames, "
+                        "error %d", txBatch.frames, err);
+        NetworkStack_STATS_ADD(nicStats.txDropped, txBatch.frames);
+    }
+    else
+    {
+        NetworkStack_STATS_ADD(nicStats.txBatchCalls, 1);
+        NetworkStack_STATS_ADD(nicStats.txBatchFrames, txBatch.frames);
+        NetworkStack_STATS_ADD(nicStats.txFrames, txBatch.frames);
+        NetworkStack_STATS_ADD(nicStats.txBytes,
+                               txBatch.used
+                               - sizeof(NetworkStack_PicoTcp_NicBatch_t));
+    }
+
+    txBatch.frames = 0;
+    txBatch.used   = sizeof(NetworkStack_PicoTcp_NicBatch_t);
+
+    return err;
+}
+
+//------------------------------------------------------------------------------
+// Append one frame to the outgoing dataport in batched mode
+static int
+nic_tx_batch_append(
+    void* buf,
+    int   len)
+{
+    const OS_Dataport_t* nic_in = get_nic_port_to();
+    uint8_t* base = OS_Dataport_getBuf(*nic_in);
+    NetworkStack_PicoTcp_NicBatch_t* batch =
+        (NetworkStack_PicoTcp_NicBatch_t*)base;
+    const size_t portSize = OS_Dataport_getSize(*nic_in);
+
+    if (len > portSize - sizeof(*batch))
+    {
+        Debug_LOG_ERROR("Buffer doesn't fit in dataport");
+        NetworkStack_STATS_ADD(nicStats.txDropped, 1);
+        return -1;
+    }
+
+    if ((txBatch.frames == NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES)
+        || (len > portSize - txBatch.used))
+    {
+        if (nic_tx_batch_flush() == OS_ERROR_TRY_AGAIN)
+        {
+            // returning 0 tells picoTCP to retry sending the current frame
+            return 0;
+        }
+    }
+
+    // This is the only copy of the frame on the TX path. picoTCP allocates the
+    // frame buffers itself and offers no hook to place them in the dataport,
+    // so the driver cannot be handed picoTCP's buffer directly.
+    memcpy(&base[txBatch.used], buf, len);
+    batch->desc[txBatch.frames].offset = txBatch.used;
+    batch->desc[txBatch.frames].len    = len;
+    txBatch.frames++;
+    txBatch.used += len;
+
+    return len;
+}
+
 //------------------------------------------------------------------------------
 // Called by picoTCP to send one frame
 static int
@@ -33,21 +309,44 @@ nic_send_frame(
     // currently we support only one NIC
     Debug_ASSERT( &os_nic == dev );
 
+    // picoTCP keeps the frame and tries again with the next tick
+    if (!nic_budget_is_left())
+    {
+        return 0;
+    }
+    budget.frames++;
+
+    if (txBatch.isEnabled)
+    {
+        return nic_tx_batch_append(buf, len);
+    }
+
     const OS_Dataport_t* nic_in = get_nic_port_to();
     void* wrbuf = OS_Dataport_getBuf(*nic_in);
     if (OS_Dataport_getSize(*nic_in) < len)
     {
         Debug_LOG_ERROR("Buffer doesn't fit in dataport");
+        NetworkStack_STATS_ADD(nicStats.txDropped, 1);
         return -1;
     }
 
-    // copy data into shared buffer and call driver
+    // copy data into shared buffer and call driver, see nic_tx_batch_append()
+    // why this copy cannot be avoided
     memcpy(wrbuf, buf, len);
     size_t wr_len = len;
     OS_Error_t err = nic_dev_write(&wr_len);
 
     if (OS_SUCCESS != err)
     {
+        if (OS_ERROR_TRY_AGAIN == err)
+        {
+            NetworkStack_STATS_ADD(nicStats.txRetries, 1);
+        }
+        else
+        {
+            NetworkStack_STATS_ADD(nicStats.txDropped, 1);
+        }
+
         switch (err)
         {
         case OS_ERROR_TRY_AGAIN:
@@ -81,10 +380,281 @@ nic_send_frame(
         Debug_ASSERT(0); // halt in debug builds
     }
 
+    NetworkStack_STATS_ADD(nicStats.txFrames, 1);
+    NetworkStack_STATS_ADD(nicStats.txBytes, len);
+
     return len;
 }
 
 
+//------------------------------------------------------------------------------
+// Fetch frames from a driver that supports batched reception. Returns
+// OS_ERROR_NOT_IMPLEMENTED if it does not.
+static OS_Error_t
+nic_poll_data_batch(
+    struct pico_device* dev,
+    int*                pLoopScore)
+{
+    const OS_Dataport_t* nw_in = get_nic_port_from();
+    uint8_t* base = OS_Dataport_getBuf(*nw_in);
+    const NetworkStack_PicoTcp_NicBatch_t* batch =
+        (const NetworkStack_PicoTcp_NicBatch_t*)base;
+
+    // The size of this dataport is given in RX ring elements, as the legacy
+    // interface uses it as ring buffer.
+    const size_t portSize = nw_in->size * sizeof(OS_NetworkStack_RxBuffer_t);
+
+    size_t framesRemaining = 1;
+
+    while (*pLoopScore > 0 && framesRemaining)
+    {
+        // Never fetch more frames than the loop score permits to process, as
+        // the driver may reuse the dataport with the next call.
+        size_t maxFrames = *pLoopScore;
+        if (maxFrames > NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES)
+        {
+            maxFrames = NetworkStack_PicoTcp_NIC_BATCH_MAX_FRAMES;
+        }
+        maxFrames = nic_budget_frames_left(maxFrames);
+        if (0 == maxFrames)
+        {
+            break;
+        }
+
+        size_t frames = 0;
+        OS_Error_t status = nic_dev_read_batch(maxFrames, &frames,
+                                               &framesRemaining);
+        if (status != OS_SUCCESS)
+        {
+            if (status == OS_ERROR_NOT_IMPLEMENTED)
+            {
+                return status;
+            }
+            if (status == OS_ERROR_NOT_INITIALIZED)
+            {
+                // Driver didn't finish initialization. Try again later.
+                Debug_LOG_DEBUG("Nic not initialized. Retrying");
+                break;
+            }
+            if (status == OS_ERROR_NO_DATA)
+            {
+                Debug_LOG_TRACE("No data to be read");
+                break;
+            }
+            Debug_LOG_ERROR("nic_dev_read_batch() failed, error %d", status);
+            break;
+        }
+
+        if (frames > maxFrames)
+        {
+            Debug_LOG_ERROR("Driver returned %zu frames, requested %zu",
+                            frames, maxFrames);
+            frames = maxFrames;
+        }
+
+        NetworkStack_STATS_ADD(nicStats.rxBatchCalls, 1);
+        NetworkStack_STATS_ADD(nicStats.rxBatchFrames, frames);
+
+        // Without any frame the loop score does not go down, so stop here
+        // instead of asking the driver again and again.
+        if (0 == frames)
+        {
+            Debug_LOG_DEBUG("Driver returned no frame, %zu frames remaining",
+                            framesRemaining);
+            break;
+        }
+
+        // A dropped frame costs loop score as well, so a driver that keeps
+        // returning invalid descriptors cannot keep this loop running.
+        for (size_t i = 0; i < frames; i++)
+        {
+            const size_t offset = batch->desc[i].offset;
+            const size_t len    = batch->desc[i].len;
+
+            (*pLoopScore)--;
+
+            if ((offset < sizeof(*batch)) || (offset > portSize)
+                || (len > portSize - offset))
+            {
+                Debug_LOG_ERROR("Dropping frame with invalid descriptor, "
+                                "offset %zu len %zu", offset, len);
+                NetworkStack_STATS_ADD(nicStats.rxDropped, 1);
+                continue;
+            }
+
+            Debug_LOG_TRACE("incoming frame len %zu", len);
+            nic_stats_rx(pico_stack_recv(dev, &base[offset], len), len);
+            budget.frames++;
+        }
+    }
+
+    if (*pLoopScore == 0 && framesRemaining)
+    {
+        NetworkStack_STATS_ADD(nicStats.loopScoreExhausted, 1);
+        // a busy polling loop comes back anyway
+        if (!pico_nic_is_busy_polling())
+        {
+            internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_NIC);
+        }
+        Debug_LOG_TRACE("Loop score is 0 but there is still data in the NIC");
+    }
+
+    return OS_SUCCESS;
+}
+
+
+//------------------------------------------------------------------------------
+// Hand a legacy RX ring slot back to the driver
+static void
+nic_rx_ring_release(
+    size_t pos)
+{
+    if (!rxRing.isHeld[pos])
+    {
+        return;
+    }
+
+    rxRing.isHeld[pos] = false;
+    rxRing.held--;
+
+    // set flag in shared memory that data has been read
+    __atomic_store_n(&rxRing.ring[pos].len, 0, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------------
+// Returns true for frames that picoTCP frees in the course of its stack ticks,
+// no matter what the clients do. picoTCP copies the payload of a TCP segment,
+// in order or not, into a buffer of its own when it processes it. A UDP
+// datagram however stays in the socket queue until the client reads it, and
+// an IP fragment until the datagram is complete.
+static bool
+nic_rx_frame_is_transient(
+    const uint8_t* frame,
+    size_t         len)
+{
+    if (len < ETH_HEADER_LEN + IPV4_HEADER_MIN_LEN)
+    {
+        return false;
+    }
+
+    const uint16_t ethType = (frame[ETH_TYPE_OFFSET] << 8)
+                             | frame[ETH_TYPE_OFFSET + 1];
+    if (ethType != ETH_TYPE_IPV4)
+    {
+        return false;
+    }
+
+    const uint8_t* ip = &frame[ETH_HEADER_LEN];
+    const uint16_t frag = (ip[IPV4_FRAG_OFFSET] << 8)
+                          | ip[IPV4_FRAG_OFFSET + 1];
+
+    return ((ip[0] >> 4) == 4)
+           && (ip[IPV4_PROTO_OFFSET] == IPV4_PROTO_TCP)
+           && (0 == (frag & IPV4_FRAG_MASK));
+}
+
+//------------------------------------------------------------------------------
+// Called by picoTCP when a frame received in place from the ring is freed
+static void
+nic_rx_ring_free_notify(
+    uint8_t* buffer)
+{
+    const OS_NetworkStack_RxBuffer_t* slot =
+        (OS_NetworkStack_RxBuffer_t*)(buffer
+                                      - offsetof(OS_NetworkStack_RxBuffer_t,
+                                                 data));
+
+    nic_rx_ring_release(slot - rxRing.ring);
+}
+
+//------------------------------------------------------------------------------
+// Pass one frame from the legacy RX ring to picoTCP
+static void
+nic_rx_ring_recv(
+    struct pico_device* dev,
+    size_t              pos)
+{
+    OS_NetworkStack_RxBuffer_t* slot = &rxRing.ring[pos];
+
+    if ((NULL == rxRing.isHeld) || (rxRing.held >= rxRing.size / 2)
+        || !nic_rx_frame_is_transient(slot->data, slot->len))
+    {
+        nic_stats_rx(pico_stack_recv(dev, slot->data, slot->len), slot->len);
+        NetworkStack_STATS_ADD(nicStats.rxFramesCopied, 1);
+        // set flag in shared memory that data has been read
+        __atomic_store_n(&slot->len, 0, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        rxRing.isHeld[pos] = true;
+        rxRing.held++;
+
+        const int ret = pico_stack_recv_zerocopy_ext_buffer_notify(
+                            dev, slot->data, slot->len,
+                            nic_rx_ring_free_notify);
+        nic_stats_rx(ret, slot->len);
+        if (ret > 0)
+        {
+            NetworkStack_STATS_ADD(nicStats.rxFramesZeroCopy, 1);
+        }
+        else
+        {
+            // picoTCP could not take the frame, it may or may not have called
+            // the notification already.
+            nic_rx_ring_release(pos);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Switches between event driven wakeups and busy polling depending on the
+// frames received by the last poll
+static void
+nic_rx_mode_update(
+    int  frames,
+    bool isLoopScoreExhausted)
+{
+#if defined(NetworkStack_PicoTcp_USE_BUSY_POLL)
+    // the clock was read at the start of the stack tick
+    const uint64_t now = clock_snapshot_get();
+
+    if (!busyPoll.isActive)
+    {
+        const bool isLoaded =
+            isLoopScoreExhausted
+            || (frames >= NetworkStack_PicoTcp_BUSY_POLL_ENTER_FRAMES);
+
+        busyPoll.loadedPolls = isLoaded ? busyPoll.loadedPolls + 1 : 0;
+        if (busyPoll.loadedPolls >= NetworkStack_PicoTcp_BUSY_POLL_ENTER_POLLS)
+        {
+            Debug_LOG_TRACE("NIC RX: switching to busy polling");
+            __atomic_store_n(&busyPoll.isActive, true, __ATOMIC_RELAXED);
+            busyPoll.deadlineMs =
+                now + NetworkStack_PicoTcp_BUSY_POLL_WINDOW_MS;
+            NetworkStack_STATS_ADD(nicStats.busyPollWindows, 1);
+            NetworkStack_STATS_SET(nicStats.rxMode,
+                                   NetworkStack_PicoTcp_RX_MODE_BUSY_POLL);
+        }
+        return;
+    }
+
+    if (frames > 0)
+    {
+        busyPoll.deadlineMs = now + NetworkStack_PicoTcp_BUSY_POLL_WINDOW_MS;
+    }
+    else if (now >= busyPoll.deadlineMs)
+    {
+        Debug_LOG_TRACE("NIC RX: switching to event driven wakeups");
+        __atomic_store_n(&busyPoll.isActive, false, __ATOMIC_RELAXED);
+        busyPoll.loadedPolls = 0;
+        NetworkStack_STATS_SET(nicStats.rxMode,
+                               NetworkStack_PicoTcp_RX_MODE_EVENT);
+    }
+#endif
+}
+
+
 //------------------------------------------------------------------------------
 // Called after notification from driver and regularly from picoTCP stack tick
 static int
@@ -95,9 +665,34 @@ nic_poll_data(
     // currently we support only one NIC
     Debug_ASSERT(&os_nic == dev);
 
+    if (isTxOnlyTick)
+    {
+        return loop_score;
+    }
+
+    NetworkStack_PROFILE_START(start);
+
+    const int initialLoopScore = loop_score;
+
+    static bool isBatchInterface  = true;
     static bool isLegacyInterface = false;
     static bool isDetectionDone   = false;
 
+    // The batched interface is tried first, if the driver does not support it
+    // we fall back to the interfaces below.
+    if (isBatchInterface == true)
+    {
+        if (nic_poll_data_batch(dev, &loop_score) != OS_ERROR_NOT_IMPLEMENTED)
+        {
+            nic_rx_mode_update(initialLoopScore - loop_score, loop_score == 0);
+            NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_NIC_POLL,
+                                       start);
+            return loop_score;
+        }
+        isBatchInterface = false;
+        Debug_LOG_INFO("Batched RX not supported, using single frame interface.");
+    }
+
     const OS_Dataport_t*        nw_in = get_nic_port_from();
     OS_NetworkStack_RxBuffer_t* buf_ptr =
         (OS_NetworkStack_RxBuffer_t*)OS_Dataport_getBuf(*nw_in);
@@ -107,7 +702,7 @@ nic_poll_data(
         size_t len;
         size_t framesRemaining = 1;
 
-        while (loop_score > 0 && framesRemaining)
+        while (loop_score > 0 && framesRemaining && nic_budget_is_left())
         {
             OS_Error_t status = nic_dev_read(&len, &framesRemaining);
             // if the return code is NOT_IMPLEMENTED it means the driver implements
@@ -129,6 +724,15 @@ nic_poll_data(
                     isLegacyInterface = true;
                     isDetectionDone   = true;
                     Debug_LOG_INFO("Falling back to legacy interface.");
+
+                    rxRing.ring   = buf_ptr;
+                    rxRing.size   = nw_in->size;
+                    rxRing.isHeld = calloc(rxRing.size, sizeof(bool));
+                    if (NULL == rxRing.isHeld)
+                    {
+                        Debug_LOG_WARNING("Out of memory, RX ring frames "
+                                          "will be copied.");
+                    }
                     break;
                 }
                 if (status == OS_ERROR_NOT_INITIALIZED)
@@ -145,14 +749,19 @@ nic_poll_data(
             }
 
             Debug_LOG_TRACE("incoming frame len %zu", len);
-            pico_stack_recv(dev, (void*)buf_ptr, len);
+            nic_stats_rx(pico_stack_recv(dev, (void*)buf_ptr, len), len);
             loop_score--;
+            budget.frames++;
             isDetectionDone = true;
         }
 
         if (loop_score == 0 && framesRemaining)
         {
-            internal_notify_main_loop();
+            NetworkStack_STATS_ADD(nicStats.loopScoreExhausted, 1);
+            if (!pico_nic_is_busy_polling())
+            {
+                internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_NIC);
+            }
             Debug_LOG_TRACE("Loop score is 0 but there is still data in the NIC");
         }
 
@@ -167,23 +776,120 @@ nic_poll_data(
             unsigned int ring_buffer_size = nw_in->size;
             // As long as the loop score permits, take the next frame stored in the
             // ring buffer.
-            while (buf_ptr[pos].len != 0 && loop_score > 0)
+            // Slots still held by picoTCP have a non-zero length, but the
+            // driver cannot have refilled them. They are released within the
+            // next stack ticks, see nic_rx_frame_is_transient().
+            while ((__atomic_load_n(&buf_ptr[pos].len, __ATOMIC_ACQUIRE) != 0)
+                   && loop_score > 0
+                   && !((NULL != rxRing.isHeld) && rxRing.isHeld[pos])
+                   && nic_budget_is_left())
             {
                 Debug_LOG_TRACE("incoming frame len %zu", buf_ptr[pos].len);
-                pico_stack_recv(dev, buf_ptr[pos].data, buf_ptr[pos].len);
+                nic_rx_ring_recv(dev, pos);
                 loop_score--;
-                // set flag in shared memory that data has been read
-                buf_ptr[pos].len = 0;
+                budget.frames++;
 
                 pos = (pos + 1) % ring_buffer_size;
             }
         }
     }
 
+    nic_rx_mode_update(initialLoopScore - loop_score, loop_score == 0);
+
+    NetworkStack_PROFILE_PHASE(NetworkStack_PicoTcp_PHASE_NIC_POLL, start);
+
     return loop_score;
 }
 
 
+//------------------------------------------------------------------------------
+// Called at the start of each stack tick
+void
+pico_nic_budget_start(void)
+{
+    budget.frames      = 0;
+    budget.isExhausted = false;
+
+    if ((NetworkStack_PicoTcp_LOOP_BUDGET_US > 0) && !budget.isCalibrated)
+    {
+        nic_budget_calibrate(clock_snapshot_get(), internal_get_timestamp());
+    }
+
+    if (budget.limitTicks > 0)
+    {
+        budget.startTicks = internal_get_timestamp();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Called at the end of each stack tick
+void
+pico_nic_flush(void)
+{
+    if (nic_tx_batch_flush() == OS_ERROR_TRY_AGAIN)
+    {
+        // The frames stay in the dataport, make sure we try again soon.
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_NIC);
+    }
+    else if (budget.isExhausted && !pico_nic_is_busy_polling())
+    {
+        // Frames were left for the next tick, the loop notifies the clients
+        // and releases the stack before it runs again.
+        internal_notify_main_loop(NetworkStack_PicoTcp_WAKE_NIC);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void
+pico_nic_set_tx_only(
+    bool isTxOnly)
+{
+    isTxOnlyTick = isTxOnly;
+}
+
+
+//------------------------------------------------------------------------------
+bool
+pico_nic_is_busy_polling(void)
+{
+#if defined(NetworkStack_PicoTcp_USE_BUSY_POLL)
+    return __atomic_load_n(&busyPoll.isActive, __ATOMIC_RELAXED);
+#else
+    return false;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+void
+pico_nic_get_statistics(
+    NetworkStack_PicoTcp_NicStatistics_t* stats)
+{
+    stats->rxFrames           = NetworkStack_STATS_GET(nicStats.rxFrames);
+    stats->rxBytes            = NetworkStack_STATS_GET(nicStats.rxBytes);
+    stats->rxDropped          = NetworkStack_STATS_GET(nicStats.rxDropped);
+    stats->txFrames           = NetworkStack_STATS_GET(nicStats.txFrames);
+    stats->txBytes            = NetworkStack_STATS_GET(nicStats.txBytes);
+    stats->txDropped          = NetworkStack_STATS_GET(nicStats.txDropped);
+    stats->txRetries          = NetworkStack_STATS_GET(nicStats.txRetries);
+    stats->loopScoreExhausted =
+        NetworkStack_STATS_GET(nicStats.loopScoreExhausted);
+    stats->busyPollWindows    =
+        NetworkStack_STATS_GET(nicStats.busyPollWindows);
+    stats->rxBatchCalls       = NetworkStack_STATS_GET(nicStats.rxBatchCalls);
+    stats->rxBatchFrames      = NetworkStack_STATS_GET(nicStats.rxBatchFrames);
+    stats->txBatchCalls       = NetworkStack_STATS_GET(nicStats.txBatchCalls);
+    stats->txBatchFrames      = NetworkStack_STATS_GET(nicStats.txBatchFrames);
+    stats->budgetExhausted    =
+        NetworkStack_STATS_GET(nicStats.budgetExhausted);
+    stats->rxFramesZeroCopy   =
+        NetworkStack_STATS_GET(nicStats.rxFramesZeroCopy);
+    stats->rxFramesCopied     = NetworkStack_STATS_GET(nicStats.rxFramesCopied);
+    stats->rxMode             = NetworkStack_STATS_GET(nicStats.rxMode);
+}
+
+
 //------------------------------------------------------------------------------
 static void
 nic_destroy(
@@ -229,6 +935,19 @@ pico_nic_initialize(const OS_NetworkStack_AddressConfig_t* config)
     Debug_LOG_INFO("MAC: %02x:%02x:%02x:%02x:%02x:%02x",
                    mac[0], mac[1], mac[2], mac[3], mac[4], mac[5] );
 
+    // A batch with zero frames just checks whether the driver supports
+    // batched transmission. Only OS_ERROR_NOT_IMPLEMENTED rules it out, a
+    // driver that is not ready yet may still support it. If it turns out not
+    // to, nic_tx_batch_flush() falls back to single frames.
+    const OS_Dataport_t* nic_in = get_nic_port_to();
+    txBatch.frames    = 0;
+    txBatch.used      = sizeof(NetworkStack_PicoTcp_NicBatch_t);
+    txBatch.isEnabled = (OS_Dataport_getSize(*nic_in) > txBatch.used)
+                        && (nic_dev_write_batch(0) != OS_ERROR_NOT_IMPLEMENTED);
+
+    Debug_LOG_INFO("Batched TX %s",
+                   txBatch.isEnabled ? "enabled" : "not supported");
+
     static const char* drv_name  = "trentos_nic_driver";
     ret = pico_device_init(pico_stack_ctx, dev, drv_name, mac);
     if (ret != 0)
@@ -0,0 +1,179 @@
+/*
+ * Network Stack profiling
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "network_stack_config.h"
+#include "network_stack_core.h"
+#include "network_stack_profile.h"
+
+#include <stddef.h>
+
+//------------------------------------------------------------------------------
+// Histograms can be updated from several threads, the buckets are counted with
+// atomic increments instead of a lock.
+void
+network_stack_histogram_add(
+    NetworkStack_PicoTcp_Histogram_t* histogram,
+    uint64_t                          duration)
+{
+    const unsigned int bucket = (duration > 0) ? 63 - __builtin_clzll(duration)
+                                : 0;
+
+    __atomic_fetch_add(
+        &histogram->count[(bucket < NetworkStack_PicoTcp_HISTOGRAM_BUCKETS) ?
+                          bucket : NetworkStack_PicoTcp_HISTOGRAM_BUCKETS - 1],
+        1,
+        __ATOMIC_RELAXED);
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_histogram_get(
+    NetworkStack_PicoTcp_Histogram_t*       dst,
+    const NetworkStack_PicoTcp_Histogram_t* src)
+{
+    for (size_t i = 0; i < NetworkStack_PicoTcp_HISTOGRAM_BUCKETS; i++)
+    {
+        dst->count[i] = __atomic_load_n(&src->count[i], __ATOMIC_RELAXED);
+    }
+}
+
+#if defined(NetworkStack_PicoTcp_USE_PROFILING)
+
+static NetworkStack_PicoTcp_Profile_t profile;
+
+// when each mutex was acquired, only written by the thread holding it
+static uint64_t mutexLockedAt[NetworkStack_PicoTcp_MUTEXES];
+
+// Total time the calling thread waited for the thread safety mutex or for its
+// queued commands, so an RPC can tell its own share of the wait from the
+// difference. With the command queue, the stack thread takes the mutex and
+// the RPC thread only waits for the command.
+static __thread uint64_t stackTSWaited;
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_phase(
+    NetworkStack_PicoTcp_Phase_t phase,
+    uint64_t                     start)
+{
+    network_stack_histogram_add(&profile.phases[phase],
+                                internal_get_timestamp() - start);
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_mutex_locked(
+    NetworkStack_PicoTcp_Mutex_t mutex,
+    uint64_t                     start)
+{
+    const uint64_t now = internal_get_timestamp();
+
+    network_stack_histogram_add(&profile.mutexes[mutex].wait, now - start);
+    mutexLockedAt[mutex] = now;
+
+    if (NetworkStack_PicoTcp_MUTEX_STACK_TS == mutex)
+    {
+        stackTSWaited += now - start;
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_command_done(
+    uint64_t start)
+{
+    stackTSWaited += internal_get_timestamp() - start;
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_mutex_unlock(
+    NetworkStack_PicoTcp_Mutex_t mutex)
+{
+    network_stack_histogram_add(&profile.mutexes[mutex].hold,
+                                internal_get_timestamp()
+                                - mutexLockedAt[mutex]);
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_get(
+    NetworkStack_PicoTcp_Profile_t* dst)
+{
+    for (size_t i = 0; i < NetworkStack_PicoTcp_PHASES; i++)
+    {
+        network_stack_histogram_get(&dst->phases[i], &profile.phases[i]);
+    }
+
+    for (size_t i = 0; i < NetworkStack_PicoTcp_MUTEXES; i++)
+    {
+        network_stack_histogram_get(&dst->mutexes[i].wait,
+                                    &profile.mutexes[i].wait);
+        network_stack_histogram_get(&dst->mutexes[i].hold,
+                                    &profile.mutexes[i].hold);
+    }
+}
+
+//------------------------------------------------------------------------------
+NetworkStack_RpcTiming_t
+network_stack_profile_rpc_begin(
+    NetworkStack_PicoTcp_Rpc_t rpc)
+{
+    const NetworkStack_RpcTiming_t timing =
+    {
+        .rpc           = rpc,
+        .start         = internal_get_timestamp(),
+        .stackTSWaited = stackTSWaited
+    };
+
+    return timing;
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_rpc_end(
+    const NetworkStack_RpcTiming_t* timing)
+{
+    const uint64_t duration = internal_get_timestamp() - timing->start;
+
+    NetworkStack_Client_t* client = get_client_from_clientId(get_client_id());
+    if (NULL == client)
+    {
+        return;
+    }
+
+    NetworkStack_PicoTcp_RpcProfile_t* const rpc = &client->rpcs[timing->rpc];
+
+    network_stack_histogram_add(&rpc->duration, duration);
+    network_stack_histogram_add(&rpc->stackTSWait,
+                                stackTSWaited - timing->stackTSWaited);
+
+    // The if_OS_Socket and the SocketBatch RPC thread may serve the same
+    // client at once.
+    uint64_t maxDuration = __atomic_load_n(&rpc->maxDuration, __ATOMIC_RELAXED);
+    while ((duration > maxDuration)
+           && !__atomic_compare_exchange_n(&rpc->maxDuration, &maxDuration,
+                                           duration, true, __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+    {
+        // maxDuration was updated to the current maximum, try again
+    }
+}
+
+//------------------------------------------------------------------------------
+void
+network_stack_profile_rpc_get(
+    NetworkStack_PicoTcp_RpcProfile_t*       dst,
+    const NetworkStack_PicoTcp_RpcProfile_t* src)
+{
+    network_stack_histogram_get(&dst->duration, &src->duration);
+    network_stack_histogram_get(&dst->stackTSWait, &src->stackTSWait);
+    dst->maxDuration = NetworkStack_STATS_GET(src->maxDuration);
+}
+
+#endif // NetworkStack_PicoTcp_USE_PROFILING
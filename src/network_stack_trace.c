@@ -0,0 +1,179 @@
+/*
+ * Network Stack trace ring
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "network_stack_core.h"
+#include "network_stack_trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(NetworkStack_PicoTcp_USE_TRACE)
+
+_Static_assert((NetworkStack_PicoTcp_TRACE_RING_SIZE
+                & (NetworkStack_PicoTcp_TRACE_RING_SIZE - 1)) == 0,
+               "trace ring size must be a power of two");
+
+typedef struct
+{
+    uint32_t seq;    // sequence number + 1 once complete, 0 while written
+    uint16_t event;
+    int32_t  handle;
+    uint32_t args[2];
+    uint64_t timeMs;
+} TraceRecord_t;
+
+// Writers claim a slot by incrementing head and publish the record by setting
+// its seq last, so any thread can trace without a lock. The reader detects
+// records that are incomplete or were overwritten while it copied them.
+static struct
+{
+    uint32_t      head; // next sequence number
+    uint32_t      tail; // next sequence number to drain, reader only
+    TraceRecord_t ring[NetworkStack_PicoTcp_TRACE_RING_SIZE];
+} trace;
+
+//------------------------------------------------------------------------------
+void
+network_stack_trace(
+    NetworkStack_TraceEvent_t event,
+    int                       handle,
+    uint32_t                  arg0,
+    uint32_t                  arg1)
+{
+    const uint32_t seq = __atomic_fetch_add(&trace.head, 1, __ATOMIC_RELAXED);
+    TraceRecord_t* const record =
+        &trace.ring[seq % NetworkStack_PicoTcp_TRACE_RING_SIZE];
+
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->event   = event;
+    record->handle  = handle;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    // no clock read here, that may be an RPC
+    record->timeMs  = clock_snapshot_get();
+
+    __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------------
+static int
+format_record(
+    char*                buf,
+    size_t               size,
+    uint32_t             seq,
+    const TraceRecord_t* record)
+{
+    const uint8_t* ip = (const uint8_t*)&record->args[0];
+    char text[64];
+
+    switch (record->event)
+    {
+    case NetworkStack_TRACE_SOCKET_OPENED:
+        snprintf(text, sizeof(text), "socket opened, type %" PRIu32,
+                 record->args[0]);
+        break;
+    case NetworkStack_TRACE_SOCKET_CLOSED:
+        snprintf(text, sizeof(text), "socket closed");
+        break;
+    case NetworkStack_TRACE_CONN_REQUEST:
+        snprintf(text, sizeof(text), "received incoming connection request");
+        break;
+    case NetworkStack_TRACE_CONN_ESTABLISHED:
+        snprintf(text, sizeof(text), "connection established to %u.%u.%u.%u",
+                 ip[0], ip[1], ip[2], ip[3]);
+        break;
+    case NetworkStack_TRACE_CONN_ACCEPTED:
+        snprintf(text, sizeof(text),
+                 "accepted incoming connection from %u.%u.%u.%u:%" PRIu32,
+                 ip[0], ip[1], ip[2], ip[3], record->args[1]);
+        break;
+    case NetworkStack_TRACE_CONN_CLOSED:
+        snprintf(text, sizeof(text), "connection closed by %u.%u.%u.%u",
+                 ip[0], ip[1], ip[2], ip[3]);
+        break;
+    default:
+        snprintf(text, sizeof(text), "event %u, args 0x%" PRIx32 " 0x%" PRIx32,
+                 record->event, record->args[0], record->args[1]);
+        break;
+    }
+
+    return snprintf(buf, size, "%" PRIu64 " ms #%" PRIu32 " [socket %d] %s\n",
+                    record->timeMs, seq, record->handle, text);
+}
+
+//------------------------------------------------------------------------------
+size_t
+network_stack_trace_drain(
+    char*  buf,
+    size_t size)
+{
+    const uint32_t head = __atomic_load_n(&trace.head, __ATOMIC_ACQUIRE);
+    uint32_t lost = 0;
+    size_t   used = 0;
+
+    if (head - trace.tail > NetworkStack_PicoTcp_TRACE_RING_SIZE)
+    {
+        lost = head - trace.tail - NetworkStack_PicoTcp_TRACE_RING_SIZE;
+        trace.tail = head - NetworkStack_PicoTcp_TRACE_RING_SIZE;
+    }
+
+    while (trace.tail != head)
+    {
+        const uint32_t seq = trace.tail;
+        const TraceRecord_t* const slot =
+            &trace.ring[seq % NetworkStack_PicoTcp_TRACE_RING_SIZE];
+
+        const uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        TraceRecord_t record;
+        memcpy(&record, slot, sizeof(record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        const uint32_t after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+        if ((before != seq + 1) || (after != seq + 1))
+        {
+            if ((0 == before) || ((int32_t)(before - (seq + 1)) < 0))
+            {
+                // still being written, try again with the next call
+                break;
+            }
+            // overwritten by a newer record
+            lost++;
+            trace.tail++;
+            continue;
+        }
+
+        char line[128];
+        const int len = format_record(line, sizeof(line), seq, &record);
+        if ((len < 0) || (used + len > size))
+        {
+            break;
+        }
+        memcpy(&buf[used], line, len);
+        used += len;
+        trace.tail++;
+    }
+
+    if (lost > 0)
+    {
+        char line[64];
+        const int len = snprintf(line, sizeof(line), "%" PRIu32
+                                 " records lost\n", lost);
+        if ((len > 0) && (used + len <= size))
+        {
+            memcpy(&buf[used], line, len);
+            used += len;
+        }
+    }
+
+    return used;
+}
+
+#endif // NetworkStack_PicoTcp_USE_TRACE